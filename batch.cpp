@@ -0,0 +1,182 @@
+#include "batch.h"
+#include "simulator.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+BatchSimulator::BatchSimulator(const std::vector<const Wire*>& targets, int lanes, const CompileOptions& options): nl_(compile_netlist(targets, options)), lanes_(lanes) {
+    if (lanes_ < 1) throw std::invalid_argument("batch simulation needs at least one lane");
+    if (has_wide_signals(nl_)) throw std::invalid_argument("batch simulation does not support signals wider than 64 bits");
+    for (size_t i = 0; i < nl_.wires.size(); ++i) index_.emplace(nl_.wires[i], i);
+    staged_.resize(nl_.commits.size() * static_cast<size_t>(lanes_));
+    reset();
+}
+
+size_t BatchSimulator::index_of(const Wire& w) const {
+    auto it = index_.find(&w);
+    if (it == index_.end()) throw std::invalid_argument("wire '" + w.name + "' is not part of this simulation");
+    return it->second;
+}
+
+size_t BatchSimulator::pokeable_index_of(const Wire& w) const {
+    size_t i = index_of(w);
+    if (!nl_.pokeable[i]) throw std::invalid_argument(not_pokeable_message(w));
+    return i;
+}
+
+template <class F>
+static inline void lanewise(long long* d, const long long* x, const long long* y, const long long* z, int n, F f) {
+    for (int l = 0; l < n; ++l) d[l] = f(x[l], y[l], z[l]);
+}
+
+#define LANE_OP(expr) lanewise(d, x, y, z, n, [](long long a, long long b, long long c) { (void)b; (void)c; return (expr); })
+
+void eval_lanes(OpType op, long long* d, const long long* x, const long long* y, const long long* z, int n) {
+    switch (op) {
+        case OpType::Constant:
+        case OpType::WireRef: LANE_OP(a); break;
+        case OpType::Add: LANE_OP(a + b); break;
+        case OpType::Sub: LANE_OP(a - b); break;
+        case OpType::Mul: LANE_OP(a * b); break;
+        case OpType::Div: LANE_OP(b == 0 ? 0 : a / b); break;
+        case OpType::Mod: LANE_OP(b == 0 ? 0 : a % b); break;
+        case OpType::BitAnd: LANE_OP(a & b); break;
+        case OpType::BitOr: LANE_OP(a | b); break;
+        case OpType::BitXor: LANE_OP(a ^ b); break;
+        case OpType::BitNot: LANE_OP(~a); break;
+        case OpType::Neg: LANE_OP(-a); break;
+        case OpType::Shl: LANE_OP(shift_left(a, b)); break;
+        case OpType::Shr: LANE_OP(shift_right(a, b)); break;
+        case OpType::LogAnd: LANE_OP(static_cast<long long>((a != 0) & (b != 0))); break;
+        case OpType::LogOr: LANE_OP(static_cast<long long>((a != 0) | (b != 0))); break;
+        case OpType::LogNot: LANE_OP(static_cast<long long>(a == 0)); break;
+        case OpType::Eq: LANE_OP(static_cast<long long>(a == b)); break;
+        case OpType::Ne: LANE_OP(static_cast<long long>(a != b)); break;
+        case OpType::Lt: LANE_OP(static_cast<long long>(a < b)); break;
+        case OpType::Le: LANE_OP(static_cast<long long>(a <= b)); break;
+        case OpType::Gt: LANE_OP(static_cast<long long>(a > b)); break;
+        case OpType::Ge: LANE_OP(static_cast<long long>(a >= b)); break;
+        case OpType::Select: LANE_OP(a != 0 ? b : c); break;
+        case OpType::MemRead: LANE_OP(a & 0); break; // needs the cells, see eval_mem_read_lanes
+    }
+}
+
+#undef LANE_OP
+
+void eval_mem_read_lanes(const FlatOp& op, long long* v, size_t stride, int begin, int end) {
+    long long* d = v + op.dst * stride;
+    const long long* addr = v + op.a * stride;
+    unsigned long long depth = static_cast<unsigned long long>(v[op.c * stride]);
+    for (int l = begin; l < end; ++l) {
+        unsigned long long i = static_cast<unsigned long long>(addr[l]);
+        d[l] = i < depth ? v[(op.b + i) * stride + l] : 0;
+    }
+}
+
+void stage_commit(const Commit& c, const long long* v, size_t stride, long long* out) {
+    const long long* src = v + c.src * stride;
+    if (c.gate < 0) { std::copy(src, src + stride, out); return; }
+    const long long* gate = v + c.gate * stride;
+    const long long* held = v + c.dst * stride;
+    for (size_t l = 0; l < stride; ++l) out[l] = gate[l] != 0 ? src[l] : held[l];
+}
+
+void stage_mem_writes(const std::vector<MemWrite>& writes, const long long* v, size_t stride, std::vector<std::pair<int, long long>>& staged) {
+    staged.resize(writes.size() * stride);
+    auto out = staged.begin();
+    for (const MemWrite& w : writes) {
+        for (size_t l = 0; l < stride; ++l) {
+            unsigned long long i = static_cast<unsigned long long>(v[w.addr * stride + l]);
+            bool hit = v[w.enable * stride + l] != 0 && i < static_cast<unsigned long long>(w.depth);
+            *out++ = std::make_pair(hit ? w.base + static_cast<int>(i) : -1, v[w.data * stride + l]);
+        }
+    }
+}
+
+void apply_mem_writes(const std::vector<std::pair<int, long long>>& staged, long long* v, size_t stride) {
+    for (size_t k = 0; k < staged.size(); ++k) {
+        if (staged[k].first >= 0) v[staged[k].first * stride + k % stride] = staged[k].second;
+    }
+}
+
+void BatchSimulator::evaluate() {
+    if (evaluated_) return;
+    for (const FlatOp& op : nl_.ops) {
+        if (op.op == OpType::MemRead) eval_mem_read_lanes(op, v_.data(), lanes_, 0, lanes_);
+        else eval_lanes(op.op, slot(op.dst), slot(op.a), slot(op.b), slot(op.c), lanes_);
+    }
+    evaluated_ = true;
+}
+
+void BatchSimulator::commit() {
+    // Two-phase commit: read every next value before any state slot changes.
+    for (size_t i = 0; i < nl_.commits.size(); ++i) stage_commit(nl_.commits[i], v_.data(), lanes_, staged_.data() + i * lanes_);
+    stage_mem_writes(nl_.mem_writes, v_.data(), lanes_, mem_staged_);
+    for (size_t i = 0; i < nl_.commits.size(); ++i) {
+        auto src = staged_.begin() + static_cast<std::ptrdiff_t>(i * lanes_);
+        std::copy(src, src + lanes_, slot(nl_.commits[i].dst));
+    }
+    apply_mem_writes(mem_staged_, v_.data(), lanes_);
+    evaluated_ = false;
+    ++cycle_;
+}
+
+void BatchSimulator::step() {
+    evaluate();
+    commit();
+}
+
+void BatchSimulator::run(int cycles) {
+    for (int t = 0; t < cycles; ++t) step();
+}
+
+std::vector<std::map<std::string, std::vector<long long>>> BatchSimulator::trace(int cycles) {
+    std::vector<std::map<std::string, std::vector<long long>>> history(static_cast<size_t>(lanes_));
+    std::vector<std::vector<long long>*> records;
+    for (auto& h : history) {
+        for (const Wire* w : nl_.wires) records.push_back(&h[w->name]);
+    }
+    for (auto* r : records) r->reserve(cycles > 0 ? static_cast<size_t>(cycles) : 0);
+
+    size_t nw = nl_.wires.size();
+    for (int t = 0; t < cycles; ++t) {
+        evaluate();
+        for (size_t i = 0; i < nw; ++i) {
+            const long long* s = slot(nl_.wire_slot[i]);
+            for (int l = 0; l < lanes_; ++l) records[l * nw + i]->push_back(s[l]);
+        }
+        commit();
+    }
+    return history;
+}
+
+void BatchSimulator::reset() {
+    v_.resize(nl_.init.size() * static_cast<size_t>(lanes_));
+    for (size_t s = 0; s < nl_.init.size(); ++s) std::fill_n(slot(static_cast<int>(s)), lanes_, nl_.init[s]);
+    cycle_ = 0;
+    evaluated_ = false;
+}
+
+void BatchSimulator::poke(const Wire& w, int lane, long long value) {
+    size_t i = pokeable_index_of(w);
+    if (lane < 0 || lane >= lanes_) throw std::out_of_range("lane out of range");
+    slot(nl_.wire_slot[i])[lane] = value & width_mask(nl_.slot_width[nl_.wire_slot[i]]);
+    evaluated_ = false;
+}
+
+void BatchSimulator::poke(const Wire& w, const std::vector<long long>& values) {
+    size_t i = pokeable_index_of(w);
+    if (values.size() != static_cast<size_t>(lanes_)) throw std::invalid_argument("poke needs one value per lane");
+    long long mask = width_mask(nl_.slot_width[nl_.wire_slot[i]]);
+    long long* s = slot(nl_.wire_slot[i]);
+    for (int l = 0; l < lanes_; ++l) s[l] = values[l] & mask;
+    evaluated_ = false;
+}
+
+long long BatchSimulator::peek(const Wire& w, int lane) {
+    size_t i = index_of(w);
+    if (lane < 0 || lane >= lanes_) throw std::out_of_range("lane out of range");
+    evaluate();
+    return slot(nl_.wire_slot[i])[lane];
+}
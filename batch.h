@@ -0,0 +1,67 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+
+#include "netlist.h"
+
+struct Wire;
+
+// d[l] = op(x[l], y[l], z[l]) for every lane l < n: the structure-of-arrays
+// kernel shared by BatchSimulator and ModuleArray.
+void eval_lanes(OpType op, long long* d, const long long* x, const long long* y, const long long* z, int n);
+// The same for a MemRead over slot storage `v` with `stride` lanes per slot,
+// for lanes [begin, end).
+void eval_mem_read_lanes(const FlatOp& op, long long* v, size_t stride, int begin, int end);
+// Values of commit `c`'s state slot after the clock edge, for all `stride`
+// lanes, written to `out`.
+void stage_commit(const Commit& c, const long long* v, size_t stride, long long* out);
+// Clock-edge memory writes in every lane: stage_mem_writes() reads the ports
+// before any commit, apply_mem_writes() stores them afterwards, in port order.
+// `staged` holds one (cell or -1, value) pair per port and lane.
+void stage_mem_writes(const std::vector<MemWrite>& writes, const long long* v, size_t stride, std::vector<std::pair<int, long long>>& staged);
+void apply_mem_writes(const std::vector<std::pair<int, long long>>& staged, long long* v, size_t stride);
+
+// Simulates `lanes` independent copies of one circuit in lockstep, e.g. one
+// per stimulus vector. Slots are stored lane-contiguous (structure of arrays)
+// so every op is a tight loop over the lanes that the compiler vectorizes.
+class BatchSimulator {
+public:
+    BatchSimulator(const std::vector<const Wire*>& targets, int lanes, const CompileOptions& options = {});
+
+    int lanes() const { return lanes_; }
+
+    void step();
+    void run(int cycles);
+    // Per-lane histories, each shaped like the result of simulate().
+    std::vector<std::map<std::string, std::vector<long long>>> trace(int cycles);
+    // Every lane returns to the wires' values at construction.
+    void reset();
+
+    void poke(const Wire& w, int lane, long long value);
+    // Set `w` in every lane at once; `values` must hold lanes() entries.
+    void poke(const Wire& w, const std::vector<long long>& values);
+    long long peek(const Wire& w, int lane);
+
+    const Netlist& netlist() const { return nl_; }
+    long long cycle() const { return cycle_; }
+
+private:
+    size_t index_of(const Wire& w) const;
+    size_t pokeable_index_of(const Wire& w) const;
+    long long* slot(int s) { return v_.data() + static_cast<size_t>(s) * lanes_; }
+    void evaluate();
+    void commit();
+
+    Netlist nl_;
+    int lanes_;
+    std::vector<long long> v_;
+    std::vector<long long> staged_;
+    std::vector<std::pair<int, long long>> mem_staged_;
+    std::unordered_map<const Wire*, size_t> index_;
+    long long cycle_ {0};
+    bool evaluated_ {false};
+};
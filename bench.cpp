@@ -0,0 +1,270 @@
+// Benchmarks the simulation engines on synthetic circuits.
+//
+//   ./bench [--cycles N] [--scale S] [--only NAME] [--engines interp,threads,event,jit,lazy,jit-lazy] [--threads T]
+//
+// Each row reports the time to build the expression graph, elaboration (the
+// Simulator constructor: lowering, and for the JIT the native build),
+// cycles/sec and ns per netlist op during the run, and the peak resident
+// memory reached while building and running that configuration.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "circuit.h"
+#include "operations.h"
+#include "simulator.h"
+#include "wire.h"
+
+// A generated circuit and the wires to simulate.
+struct Design {
+    Circuit circuit;
+    std::vector<const Wire*> targets;
+
+    Wire& wire(const std::string& name, long long init = 0, int width = 64) { return circuit.wire(name, init, width); }
+};
+
+// Long ripple of dependent adds feeding one register: one op per level.
+static void adder_chain(Design& c, int n) {
+    Wire& in = c.wire("in", 1);
+    Wire& acc = c.wire("acc");
+    Expr prev = acc;
+    for (int i = 0; i < n; ++i) {
+        Wire& w = c.wire("add" + std::to_string(i));
+        w = prev + in;
+        prev = w;
+    }
+    acc << prev;
+    c.targets.push_back(&acc);
+}
+
+// Independent 16-bit Fibonacci LFSRs: wide and shallow, all state toggles.
+static void lfsr_farm(Design& c, int n) {
+    for (int i = 0; i < n; ++i) {
+        Wire& r = c.wire("lfsr" + std::to_string(i), 1 + i % 65535, 16);
+        Expr tap = ((Expr(r) >> 15) ^ (Expr(r) >> 13) ^ (Expr(r) >> 12) ^ (Expr(r) >> 10)) & 1;
+        r << ((Expr(r) << 1) | tap);
+        c.targets.push_back(&r);
+    }
+}
+
+// Binary tree of If() over 2^depth counters, selected by bits of a
+// free-running select register.
+static void mux_tree(Design& c, int depth) {
+    Wire& sel = c.wire("sel");
+    sel << sel + 1;
+    std::vector<Expr> level;
+    for (int i = 0; i < (1 << depth); ++i) {
+        Wire& leaf = c.wire("leaf" + std::to_string(i), i);
+        leaf << leaf + (i % 7 + 1);
+        level.push_back(leaf);
+    }
+    for (int d = 0; level.size() > 1; ++d) {
+        std::vector<Expr> next;
+        for (size_t i = 0; i + 1 < level.size(); i += 2) next.push_back(If((Expr(sel) >> d) & 1, level[i + 1], level[i]));
+        level = next;
+    }
+    Wire& out = c.wire("out");
+    out << level[0];
+    c.targets.push_back(&out);
+}
+
+// `stages` register stages of `lanes` registers each, with a little mixing
+// logic between stages.
+static void pipeline(Design& c, int stages, int lanes) {
+    std::vector<Wire*> prev;
+    for (int l = 0; l < lanes; ++l) {
+        Wire& in = c.wire("in" + std::to_string(l), l);
+        in << in + 1;
+        prev.push_back(&in);
+    }
+    for (int s = 0; s < stages; ++s) {
+        std::vector<Wire*> cur;
+        for (int l = 0; l < lanes; ++l) {
+            Wire& r = c.wire("s" + std::to_string(s) + "_" + std::to_string(l));
+            const Wire& a = *prev[l];
+            const Wire& b = *prev[(l + 1) % lanes];
+            r << ((a ^ (Expr(b) << 1)) + (s + 1)) * 3;
+            cur.push_back(&r);
+        }
+        prev = cur;
+    }
+    for (Wire* w : prev) c.targets.push_back(w);
+}
+
+// Random DAG of `n` combinational wires over a pool of inputs and registers.
+// Operands are drawn from the last `window` signals, so a smaller window
+// means deeper logic and a larger one more fanout per signal.
+static void random_netlist(Design& c, int n, int window, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<Expr> pool;
+    std::vector<Wire*> regs;
+    for (int i = 0; i < 16; ++i) pool.push_back(c.wire("in" + std::to_string(i), static_cast<long long>(rng() % 1000)));
+    for (int i = 0; i < n / 16 + 1; ++i) {
+        Wire& r = c.wire("r" + std::to_string(i), static_cast<long long>(rng() % 1000));
+        regs.push_back(&r);
+        pool.push_back(r);
+    }
+    // Distinct operands, so the optimizer cannot fold x - x, x ^ x, ...
+    auto pick2 = [&](Expr& x, Expr& y) {
+        size_t lo = pool.size() > static_cast<size_t>(window) ? pool.size() - window : 0;
+        size_t span = pool.size() - lo;
+        size_t i = rng() % span, j = (i + 1 + rng() % (span - 1)) % span;
+        x = pool[lo + i];
+        y = pool[lo + j];
+    };
+    for (int i = 0; i < n; ++i) {
+        Expr x, y;
+        pick2(x, y);
+        Expr e;
+        switch (rng() % 8) {
+            case 0: e = x + y; break;
+            case 1: e = x - y; break;
+            case 2: e = x * y; break;
+            case 3: e = x ^ y; break;
+            case 4: e = x & y; break;
+            case 5: e = x | y; break;
+            case 6: e = If(x < y, x, y); break;
+            default: e = x >> (y & 7); break;
+        }
+        Wire& w = c.wire("n" + std::to_string(i));
+        w = e;
+        pool.push_back(w);
+    }
+    // Each register folds in signals from anywhere in the pool, so most of
+    // the logic stays live after dead-code elimination.
+    for (Wire* r : regs) {
+        Expr next = *r;
+        for (int k = 0; k < 16; ++k) next = next ^ pool[rng() % pool.size()];
+        *r << next;
+        c.targets.push_back(r);
+    }
+}
+
+struct Config {
+    std::string name;
+    SimOptions options;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Peak resident set in MiB. Linux lets the high-water mark be reset, which
+// makes the figure per configuration; elsewhere it is the process peak.
+static void reset_peak_memory() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+static double peak_memory_mib() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::atof(line.c_str() + 6) / 1024.0;
+    }
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss / 1024.0;
+}
+
+int main(int argc, char** argv) {
+    long long cycles = 2000;
+    int scale = 1;
+    int threads = 4;
+    std::string only;
+    std::string engines = "interp,threads,event,jit";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) { std::cerr << "missing value for " << arg << "\n"; return 2; }
+        if (arg == "--cycles") cycles = std::atoll(value);
+        else if (arg == "--scale") scale = std::atoi(value);
+        else if (arg == "--threads") threads = std::atoi(value);
+        else if (arg == "--only") only = value;
+        else if (arg == "--engines") engines = value;
+        else { std::cerr << "unknown option " << arg << "\n"; return 2; }
+        ++i;
+    }
+
+    struct Shape {
+        std::string name;
+        std::function<void(Design&)> build;
+    };
+    std::vector<Shape> shapes = {
+        { "adder_chain", [=](Design& c) { adder_chain(c, 5000 * scale); } },
+        { "lfsr_farm", [=](Design& c) { lfsr_farm(c, 1000 * scale); } },
+        { "mux_tree", [=](Design& c) { mux_tree(c, 10 + (scale > 1 ? scale / 2 : 0)); } },
+        { "pipeline", [=](Design& c) { pipeline(c, 32, 32 * scale); } },
+        { "random_narrow", [=](Design& c) { random_netlist(c, 10000 * scale, 8, 1); } },
+        { "random_wide", [=](Design& c) { random_netlist(c, 10000 * scale, 4096, 2); } },
+    };
+
+    std::vector<Config> configs;
+    auto wanted = [&](const char* e) { return ("," + engines + ",").find(std::string(",") + e + ",") != std::string::npos; };
+    if (wanted("interp")) configs.push_back({ "interp", SimOptions() });
+    if (wanted("threads")) {
+        SimOptions o;
+        o.threads = threads;
+        configs.push_back({ "threads" + std::to_string(threads), o });
+    }
+    if (wanted("event")) {
+        SimOptions o;
+        o.engine = Engine::EventDriven;
+        configs.push_back({ "event", o });
+    }
+    if (wanted("jit")) {
+        SimOptions o;
+        o.engine = Engine::Jit;
+        configs.push_back({ "jit", o });
+    }
+    if (wanted("lazy")) {
+        SimOptions o;
+        o.lazy = true;
+        configs.push_back({ "lazy", o });
+    }
+    if (wanted("jit-lazy")) {
+        SimOptions o;
+        o.engine = Engine::Jit;
+        o.lazy = true;
+        configs.push_back({ "jit-lazy", o });
+    }
+
+    std::printf("%-14s %-9s %9s %9s %9s %12s %9s %9s\n", "circuit", "engine", "ops", "build_ms", "elab_ms", "cycles/s", "ns/op", "peak_MiB");
+    for (const Shape& shape : shapes) {
+        if (!only.empty() && shape.name != only) continue;
+        for (const Config& cfg : configs) {
+            reset_peak_memory();
+            auto t0 = std::chrono::steady_clock::now();
+            Design c;
+            {
+                ArenaScope scope(c.circuit.arena());
+                shape.build(c);
+            }
+            double build = seconds_since(t0);
+            try {
+                t0 = std::chrono::steady_clock::now();
+                Simulator sim(c.targets, cfg.options);
+                double elab = seconds_since(t0);
+                sim.step(); // warm caches and page in state before timing
+                t0 = std::chrono::steady_clock::now();
+                sim.run(static_cast<int>(cycles));
+                double run = seconds_since(t0);
+                size_t ops = sim.netlist().ops.size();
+                std::printf("%-14s %-9s %9zu %9.1f %9.1f %12.0f %9.3f %9.1f\n", shape.name.c_str(), cfg.name.c_str(), ops,
+                            build * 1e3, elab * 1e3, cycles / run, ops ? run * 1e9 / (double(cycles) * ops) : 0.0, peak_memory_mib());
+            } catch (const std::exception& e) {
+                std::printf("%-14s %-9s failed: %s\n", shape.name.c_str(), cfg.name.c_str(), e.what());
+            }
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
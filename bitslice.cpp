@@ -0,0 +1,111 @@
+#include "bitslice.h"
+#include "simulator.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+BitSliceSimulator::BitSliceSimulator(const std::vector<const Wire*>& targets, int words, const CompileOptions& options)
+    : nl_(compile_netlist(targets, options)), words_(words) {
+    if (words_ < 1) throw std::invalid_argument("bit-sliced simulation needs at least one word");
+    if (!nl_.memories.empty()) throw std::invalid_argument("bit-sliced simulation does not support memories");
+    if (!nl_.clocks.empty()) throw std::invalid_argument("bit-sliced simulation does not support clock domains");
+    for (size_t i = 0; i < nl_.wires.size(); ++i) {
+        if (nl_.slot_width[nl_.wire_slot[i]] != 1) throw std::invalid_argument("bit-sliced simulation needs 1-bit logic, but wire '" + nl_.wires[i]->name + "' is wider");
+    }
+    for (const FlatOp& op : nl_.ops) {
+        for (int s : {op.dst, op.a, op.b, op.c}) {
+            if (nl_.slot_width[s] != 1) throw std::invalid_argument("bit-sliced simulation needs 1-bit logic, but an intermediate expression is wider");
+        }
+    }
+    for (size_t i = 0; i < nl_.wires.size(); ++i) index_.emplace(nl_.wires[i], i);
+    staged_.resize(nl_.commits.size() * static_cast<size_t>(words_));
+    reset();
+}
+
+size_t BitSliceSimulator::index_of(const Wire& w) const {
+    auto it = index_.find(&w);
+    if (it == index_.end()) throw std::invalid_argument("wire '" + w.name + "' is not part of this simulation");
+    return it->second;
+}
+
+// Every value is 0 or 1, so each op reduces to boolean algebra on bit planes.
+static void eval_planes(OpType op, uint64_t* d, const uint64_t* x, const uint64_t* y, const uint64_t* z, int n) {
+    for (int k = 0; k < n; ++k) {
+        uint64_t a = x[k], b = y[k], c = z[k], r = 0;
+        switch (op) {
+            case OpType::Constant:
+            case OpType::WireRef: r = a; break;
+            case OpType::BitAnd: case OpType::LogAnd: case OpType::Mul: case OpType::Div: r = a & b; break;
+            case OpType::BitOr: case OpType::LogOr: r = a | b; break;
+            case OpType::BitXor: case OpType::Ne: r = a ^ b; break;
+            case OpType::Eq: r = ~(a ^ b); break;
+            case OpType::LogNot: r = ~a; break;
+            case OpType::Lt: r = ~a & b; break;
+            case OpType::Le: r = ~a | b; break;
+            case OpType::Gt: r = a & ~b; break;
+            case OpType::Ge: r = a | ~b; break;
+            case OpType::Shr: r = a & ~b; break;
+            case OpType::Select: r = (a & b) | (~a & c); break;
+            default: r = 0; break; // Mod of 1-bit values is always 0; wider ops are rejected up front
+        }
+        d[k] = r;
+    }
+}
+
+void BitSliceSimulator::evaluate() {
+    if (evaluated_) return;
+    for (const FlatOp& op : nl_.ops) eval_planes(op.op, slot(op.dst), slot(op.a), slot(op.b), slot(op.c), words_);
+    evaluated_ = true;
+}
+
+void BitSliceSimulator::commit() {
+    for (size_t i = 0; i < nl_.commits.size(); ++i) {
+        const Commit& c = nl_.commits[i];
+        const uint64_t* src = slot(c.src);
+        auto out = staged_.begin() + static_cast<std::ptrdiff_t>(i * words_);
+        if (c.gate < 0) { std::copy(src, src + words_, out); continue; }
+        const uint64_t* gate = slot(c.gate);
+        const uint64_t* held = slot(c.dst);
+        for (int k = 0; k < words_; ++k) out[k] = (gate[k] & src[k]) | (~gate[k] & held[k]);
+    }
+    for (size_t i = 0; i < nl_.commits.size(); ++i) {
+        auto src = staged_.begin() + static_cast<std::ptrdiff_t>(i * words_);
+        std::copy(src, src + words_, slot(nl_.commits[i].dst));
+    }
+    evaluated_ = false;
+    ++cycle_;
+}
+
+void BitSliceSimulator::step() {
+    evaluate();
+    commit();
+}
+
+void BitSliceSimulator::run(int cycles) {
+    for (int t = 0; t < cycles; ++t) step();
+}
+
+void BitSliceSimulator::reset() {
+    bits_.resize(nl_.init.size() * static_cast<size_t>(words_));
+    for (size_t s = 0; s < nl_.init.size(); ++s) std::fill_n(slot(static_cast<int>(s)), words_, nl_.init[s] ? ~uint64_t(0) : 0);
+    cycle_ = 0;
+    evaluated_ = false;
+}
+
+void BitSliceSimulator::poke(const Wire& w, int lane, bool value) {
+    size_t i = index_of(w);
+    if (!nl_.pokeable[i]) throw std::invalid_argument(not_pokeable_message(w));
+    if (lane < 0 || lane >= lanes()) throw std::out_of_range("lane out of range");
+    uint64_t& word = slot(nl_.wire_slot[i])[lane / 64];
+    uint64_t bit = uint64_t(1) << (lane % 64);
+    word = value ? (word | bit) : (word & ~bit);
+    evaluated_ = false;
+}
+
+bool BitSliceSimulator::peek(const Wire& w, int lane) {
+    size_t i = index_of(w);
+    if (lane < 0 || lane >= lanes()) throw std::out_of_range("lane out of range");
+    evaluate();
+    return (slot(nl_.wire_slot[i])[lane / 64] >> (lane % 64)) & 1;
+}
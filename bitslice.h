@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "netlist.h"
+
+struct Wire;
+
+// Bit-sliced simulation of purely 1-bit logic: every slot is packed as one
+// bit per lane in 64-bit words, so each op advances 64 stimulus vectors
+// with a single bitwise instruction per word. Requires every slot of the
+// netlist to be inferred 1 bit wide (declare inputs and registers with
+// width 1 and build logic from &, |, ^, !, &&, ||, comparisons and If()).
+class BitSliceSimulator {
+public:
+    // `words` 64-lane words per slot. Throws std::invalid_argument when the
+    // netlist contains a slot wider than one bit.
+    BitSliceSimulator(const std::vector<const Wire*>& targets, int words = 1, const CompileOptions& options = {});
+
+    int lanes() const { return words_ * 64; }
+
+    void step();
+    void run(int cycles);
+    void reset();
+
+    void poke(const Wire& w, int lane, bool value);
+    bool peek(const Wire& w, int lane);
+
+    const Netlist& netlist() const { return nl_; }
+    long long cycle() const { return cycle_; }
+
+private:
+    size_t index_of(const Wire& w) const;
+    uint64_t* slot(int s) { return bits_.data() + static_cast<size_t>(s) * words_; }
+    void evaluate();
+    void commit();
+
+    Netlist nl_;
+    int words_;
+    std::vector<uint64_t> bits_;
+    std::vector<uint64_t> staged_;
+    std::unordered_map<const Wire*, size_t> index_;
+    long long cycle_ {0};
+    bool evaluated_ {false};
+};
@@ -0,0 +1,49 @@
+#include "checkpoint.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+static const char kCheckpointMagic[4] = {'C', 'K', 'P', '1'};
+
+static void put64(std::string& out, uint64_t v) {
+    for (int k = 0; k < 8; ++k) out.push_back(static_cast<char>(v >> (8 * k)));
+}
+
+static uint64_t get64(const std::string& data, size_t pos) {
+    uint64_t v = 0;
+    for (int k = 0; k < 8; ++k) v |= static_cast<uint64_t>(static_cast<uint8_t>(data[pos + k])) << (8 * k);
+    return v;
+}
+
+void save_checkpoint(const Checkpoint& cp, const std::string& path) {
+    std::string out(kCheckpointMagic, sizeof kCheckpointMagic);
+    out.reserve(sizeof kCheckpointMagic + 8 * (3 + cp.state.size()));
+    put64(out, cp.signature);
+    put64(out, static_cast<uint64_t>(cp.cycle));
+    put64(out, cp.state.size());
+    for (long long v : cp.state) put64(out, static_cast<uint64_t>(v));
+    std::ofstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open '" + path + "' for writing");
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (!file) throw std::runtime_error("checkpoint write to '" + path + "' failed");
+}
+
+Checkpoint load_checkpoint(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open '" + path + "'");
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const size_t header = sizeof kCheckpointMagic + 3 * 8;
+    if (data.size() < header || data.compare(0, sizeof kCheckpointMagic, std::string(kCheckpointMagic, sizeof kCheckpointMagic)) != 0) {
+        throw std::runtime_error("checkpoint: '" + path + "' is not a checkpoint file");
+    }
+    Checkpoint cp;
+    cp.signature = get64(data, 4);
+    cp.cycle = static_cast<long long>(get64(data, 12));
+    uint64_t words = get64(data, 20);
+    if (words != (data.size() - header) / 8 || (data.size() - header) % 8) throw std::runtime_error("checkpoint: '" + path + "' is truncated");
+    cp.state.resize(words);
+    for (size_t i = 0; i < words; ++i) cp.state[i] = static_cast<long long>(get64(data, header + 8 * i));
+    return cp;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Mutable state of a Simulator at the start of one cycle: every register,
+// input, memory entry and clock counter, bit-packed in slot order at its
+// declared width, so a 1-bit register takes one bit. It can only be restored into a simulator
+// compiled from the same circuit, which `signature` identifies.
+struct Checkpoint {
+    unsigned long long signature {0};
+    long long cycle {0};
+    std::vector<long long> state;
+};
+
+// Binary file: a 4-byte magic, signature, cycle and word count as 64-bit
+// little-endian integers, then the state words. Both throw std::runtime_error
+// on I/O failure or a malformed file.
+void save_checkpoint(const Checkpoint& cp, const std::string& path);
+Checkpoint load_checkpoint(const std::string& path);
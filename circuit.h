@@ -0,0 +1,67 @@
+#pragma once
+
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "operations.h"
+#include "wire.h"
+
+// One design: owns its wires and the arena holding their expression nodes,
+// and frees both together. Expressions over the circuit's wires are built in
+// its arena without further setup, so independent circuits can be built and
+// simulated on different threads at once; any number of Simulators may also
+// run the same circuit concurrently, since simulation state lives in the
+// Simulator.
+//
+//     Circuit c;
+//     Wire& a = c.wire("a");
+//     Wire& acc = c.wire("acc");
+//     acc << acc + a;
+//
+// Expressions without any of its wires, like a bare Expr(5), go to the
+// locked default arena unless an ArenaScope selects c.arena().
+class Circuit {
+public:
+    Circuit() = default;
+    Circuit(const Circuit&) = delete;
+    Circuit& operator=(const Circuit&) = delete;
+
+    // A new wire owned by the circuit; the reference stays valid for the
+    // circuit's lifetime. Throws std::invalid_argument for a duplicate name.
+    Wire& wire(const std::string& name, long long init = 0, int width = 64) {
+        if (by_name_.count(name)) throw std::invalid_argument("circuit already has a wire named '" + name + "'");
+        wires_.emplace_back(name, init, width);
+        wires_.back().arena = &arena_;
+        by_name_.emplace(name, &wires_.back());
+        return wires_.back();
+    }
+
+    // The wire called `name`, or nullptr.
+    Wire* find(const std::string& name) {
+        auto it = by_name_.find(name);
+        return it == by_name_.end() ? nullptr : it->second;
+    }
+    const Wire* find(const std::string& name) const {
+        auto it = by_name_.find(name);
+        return it == by_name_.end() ? nullptr : it->second;
+    }
+
+    // Every wire in creation order.
+    std::vector<const Wire*> wires() const {
+        std::vector<const Wire*> all;
+        for (const Wire& w : wires_) all.push_back(&w);
+        return all;
+    }
+    size_t size() const { return wires_.size(); }
+
+    ExprArena& arena() { return arena_; }
+
+private:
+    // Declared first so it is destroyed last, after the wires pointing into it.
+    ExprArena arena_;
+    std::deque<Wire> wires_;
+    std::unordered_map<std::string, Wire*> by_name_;
+};
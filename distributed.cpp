@@ -0,0 +1,207 @@
+#include "distributed.h"
+#include "simulator.h"
+#include "wire.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+// Control block at the start of the shared area. The atomics are lock-free,
+// so they work across the processes mapping it.
+struct ExchangeArea {
+    std::atomic<unsigned> arrived {0};
+    std::atomic<unsigned> generation {0};
+    std::atomic<unsigned long long> command {0}; // bumped once per run()
+    std::atomic<long long> cycles {0};
+    std::atomic<int> quit {0};
+    pid_t owner {::getpid()};
+};
+
+// A worker whose owning process died without stopping it exits on its own.
+static void exit_if_orphaned(const ExchangeArea& area) {
+    if (::getpid() != area.owner && ::getppid() != area.owner) ::_exit(1);
+}
+
+static size_t area_header() { return (sizeof(ExchangeArea) + 63) / 64 * 64; }
+
+DistributedSimulator::DistributedSimulator(const std::vector<const Wire*>& targets, int processes, const CompileOptions& options)
+    : nl_(compile_netlist(targets, options)) {
+    if (processes < 1) throw std::invalid_argument("distributed simulation needs at least one process");
+    if (has_wide_signals(nl_)) throw std::invalid_argument("distributed simulation does not support signals wider than 64 bits");
+    part_ = partition_netlist(nl_, processes);
+    for (size_t i = 0; i < nl_.wires.size(); ++i) index_.emplace(nl_.wires[i], i);
+
+    area_bytes_ = area_header() + (nl_.init.size() + 2 * part_.exchange_words) * sizeof(long long);
+    void* mem = ::mmap(nullptr, area_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) throw std::runtime_error("cannot map the shared exchange area");
+    area_ = new (mem) ExchangeArea();
+    state_ = reinterpret_cast<long long*>(static_cast<char*>(mem) + area_header());
+    exchange_ = state_ + nl_.init.size();
+    // Sized for the largest piece here, so workers never allocate after the fork.
+    for (const NetlistPiece& piece : part_.pieces) {
+        v_.resize(std::max(v_.size(), piece.global_slot.size()));
+        staged_.resize(std::max(staged_.size(), piece.commits.size()));
+        mem_staged_.resize(std::max(mem_staged_.size(), piece.mem_writes.size()));
+    }
+    reset();
+    for (size_t p = 1; p < part_.pieces.size(); ++p) {
+        pid_t pid = ::fork();
+        if (pid == 0) worker_loop(p);
+        if (pid < 0) {
+            stop();
+            throw std::runtime_error("cannot start a simulation worker process");
+        }
+        workers_.push_back(pid);
+    }
+}
+
+DistributedSimulator::~DistributedSimulator() { stop(); }
+
+void DistributedSimulator::stop() {
+    if (!area_) return;
+    area_->quit.store(1, std::memory_order_release);
+    for (pid_t pid : workers_) ::waitpid(pid, nullptr, 0);
+    workers_.clear();
+    area_->~ExchangeArea();
+    ::munmap(area_, area_bytes_);
+    area_ = nullptr;
+}
+
+void DistributedSimulator::check_running() const {
+    if (!area_) throw std::runtime_error("distributed simulation stopped after a worker process failed");
+}
+
+// Called by the owning process while it waits: a worker that exited or was
+// killed will never reach the barrier, so stop the others and report it.
+void DistributedSimulator::check_workers() {
+    for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+        if (::waitpid(*it, nullptr, WNOHANG) == 0) continue;
+        workers_.erase(it);
+        stop();
+        throw std::runtime_error("a simulation worker process exited unexpectedly");
+    }
+}
+
+size_t DistributedSimulator::index_of(const Wire& w) const {
+    auto it = index_.find(&w);
+    if (it == index_.end()) throw std::invalid_argument("wire '" + w.name + "' is not part of this simulation");
+    return it->second;
+}
+
+// Sense-reversing barrier over all pieces. Waiting spins briefly, then yields.
+void DistributedSimulator::barrier() {
+    unsigned gen = area_->generation.load(std::memory_order_acquire);
+    if (area_->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == part_.pieces.size()) {
+        area_->arrived.store(0, std::memory_order_relaxed);
+        area_->generation.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    bool owner = ::getpid() == area_->owner;
+    for (int spins = 0; area_->generation.load(std::memory_order_acquire) == gen;) {
+        if (spins < 1000) { ++spins; continue; }
+        std::this_thread::yield();
+        if (owner) {
+            check_workers();
+        } else {
+            if (area_->quit.load(std::memory_order_acquire)) ::_exit(1);
+            exit_if_orphaned(*area_);
+        }
+    }
+}
+
+void DistributedSimulator::worker_loop(size_t piece) {
+    // An exception must not unwind into the forked copy of the caller's code.
+    try {
+        serve(piece);
+    } catch (...) {
+    }
+    ::_exit(1);
+}
+
+void DistributedSimulator::serve(size_t piece) {
+    unsigned long long seen = 0;
+    for (;;) {
+        unsigned long long command;
+        for (int spins = 0; (command = area_->command.load(std::memory_order_acquire)) == seen;) {
+            if (area_->quit.load(std::memory_order_acquire)) ::_exit(0);
+            if (spins < 1000) { ++spins; continue; }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            exit_if_orphaned(*area_);
+        }
+        seen = command;
+        run_piece(piece, area_->cycles.load(std::memory_order_relaxed));
+        barrier();
+    }
+}
+
+void DistributedSimulator::run_piece(size_t p, long long cycles) {
+    const NetlistPiece& piece = part_.pieces[p];
+    long long* v = v_.data();
+    for (int s : piece.leaves) v[s] = state_[piece.global_slot[s]];
+    // Every piece must have read the state before any stores its new values.
+    barrier();
+    for (long long t = 0; t < cycles; ++t) {
+        for (const FlatOp& op : piece.ops) {
+            v[op.dst] = op.op == OpType::MemRead ? eval_mem_read(op, v) : eval_op(op.op, v[op.a], v[op.b], v[op.c]);
+        }
+        for (size_t i = 0; i < piece.commits.size(); ++i) staged_[i] = commit_value(piece.commits[i], v);
+        for (size_t i = 0; i < piece.mem_writes.size(); ++i) {
+            const MemWrite& w = piece.mem_writes[i];
+            mem_staged_[i] = std::make_pair(mem_write_cell(w, v), v[w.data]);
+        }
+        for (size_t i = 0; i < piece.commits.size(); ++i) v[piece.commits[i].dst] = staged_[i];
+        for (const auto& w : mem_staged_) if (w.first >= 0) v[w.first] = w.second;
+        // The last edge's boundary values are stored with the state below.
+        if (t + 1 == cycles) break;
+        // Alternating buffers let a piece publish edge t + 1 while a slower
+        // one is still reading edge t, so one barrier per edge suffices.
+        long long* buf = exchange_ + (t & 1) * part_.exchange_words;
+        for (const auto& e : piece.exports) buf[e.second] = v[e.first];
+        barrier();
+        for (const auto& i : piece.imports) v[i.first] = buf[i.second];
+    }
+    for (int s : piece.owned) state_[piece.global_slot[s]] = v[s];
+}
+
+void DistributedSimulator::run(long long cycles) {
+    check_running();
+    if (cycles <= 0) return;
+    if (!part_.pieces.empty()) {
+        area_->cycles.store(cycles, std::memory_order_relaxed);
+        area_->command.fetch_add(1, std::memory_order_release);
+        run_piece(0, cycles);
+        barrier();
+    }
+    cycle_ += cycles;
+}
+
+void DistributedSimulator::reset() {
+    check_running();
+    std::copy(nl_.init.begin(), nl_.init.end(), state_);
+    cycle_ = 0;
+}
+
+void DistributedSimulator::poke(const Wire& w, long long value) {
+    check_running();
+    size_t i = index_of(w);
+    if (!nl_.pokeable[i]) throw std::invalid_argument(not_pokeable_message(w));
+    int slot = nl_.wire_slot[i];
+    state_[slot] = value & width_mask(nl_.slot_width[slot]);
+}
+
+long long DistributedSimulator::peek(const Wire& w) {
+    check_running();
+    size_t i = index_of(w);
+    std::vector<long long> v(state_, state_ + nl_.init.size());
+    for (const FlatOp& op : nl_.ops) {
+        v[op.dst] = op.op == OpType::MemRead ? eval_mem_read(op, v.data()) : eval_op(op.op, v[op.a], v[op.b], v[op.c]);
+    }
+    return v[nl_.wire_slot[i]];
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "netlist.h"
+#include "partition.h"
+
+struct Wire;
+struct ExchangeArea;
+
+// Simulates one circuit split across processes. The netlist is cut with
+// partition_netlist() and every piece but the first is run by a worker
+// process forked at construction; the calling process runs the first. The
+// pieces share nothing but one shared-memory area: per clock edge each
+// writes its boundary registers there and waits at a single barrier before
+// reading the others'. Since that exchange is all that crosses pieces, a
+// message-passing transport could replace the area to spread them over nodes.
+//
+// Construct it before starting other threads, as workers are forked.
+class DistributedSimulator {
+public:
+    // Throws std::invalid_argument if processes < 1 or the circuit has
+    // signals wider than 64 bits, and std::runtime_error if the shared area
+    // cannot be mapped or a worker cannot be started.
+    DistributedSimulator(const std::vector<const Wire*>& targets, int processes, const CompileOptions& options = {});
+    ~DistributedSimulator();
+
+    DistributedSimulator(const DistributedSimulator&) = delete;
+    DistributedSimulator& operator=(const DistributedSimulator&) = delete;
+
+    // Advance `cycles` clock edges on all pieces. Throws std::runtime_error
+    // if a worker process exits or is killed; the simulation is then stopped
+    // and every later call throws the same.
+    void run(long long cycles);
+    // Return every slot to its value at construction.
+    void reset();
+
+    // Same rules as Simulator::poke: registers and input wires only.
+    void poke(const Wire& w, long long value);
+    // Value of `w` in the current cycle. Evaluates the whole netlist once in
+    // the calling process, so it is meant for results, not per-cycle probes.
+    long long peek(const Wire& w);
+
+    const Netlist& netlist() const { return nl_; }
+    const NetlistPartition& partition() const { return part_; }
+    int processes() const { return static_cast<int>(part_.pieces.size()); }
+    long long cycle() const { return cycle_; }
+
+private:
+    size_t index_of(const Wire& w) const;
+    void run_piece(size_t piece, long long cycles);
+    [[noreturn]] void worker_loop(size_t piece);
+    void serve(size_t piece);
+    void barrier();
+    void check_workers();
+    void check_running() const;
+    void stop();
+
+    Netlist nl_;
+    NetlistPartition part_;
+    std::unordered_map<const Wire*, size_t> index_;
+    ExchangeArea* area_ {nullptr};
+    size_t area_bytes_ {0};
+    long long* state_ {nullptr};     // committed state between runs, in netlist slots
+    long long* exchange_ {nullptr};  // two buffers of part_.exchange_words, by cycle parity
+    std::vector<pid_t> workers_;
+    std::vector<long long> v_;       // slots of the piece this process runs
+    std::vector<long long> staged_;
+    std::vector<std::pair<int, long long>> mem_staged_;
+    long long cycle_ {0};
+};
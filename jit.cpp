@@ -0,0 +1,248 @@
+#include "jit.h"
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// Ops per generated function; keeps the host compiler fast on very large netlists.
+static const size_t kOpsPerFunction = 2000;
+
+static std::string slot_ref(int s) { return "v[" + std::to_string(s) + "]"; }
+
+static std::string emit_op(const FlatOp& op) {
+    std::string x = slot_ref(op.a), y = slot_ref(op.b), z = slot_ref(op.c);
+    std::string e;
+    switch (op.op) {
+        case OpType::Constant:
+        case OpType::WireRef: e = x; break;
+        case OpType::Add: e = x + " + " + y; break;
+        case OpType::Sub: e = x + " - " + y; break;
+        case OpType::Mul: e = x + " * " + y; break;
+        case OpType::Div: e = y + " == 0 ? 0 : " + x + " / " + y; break;
+        case OpType::Mod: e = y + " == 0 ? 0 : " + x + " % " + y; break;
+        case OpType::BitAnd: e = x + " & " + y; break;
+        case OpType::BitOr: e = x + " | " + y; break;
+        case OpType::BitXor: e = x + " ^ " + y; break;
+        case OpType::BitNot: e = "~" + x; break;
+        case OpType::Neg: e = "-" + x; break;
+        // Same out-of-range rules as shift_left/shift_right in netlist.h.
+        case OpType::Shl: e = "(unsigned long long)" + y + " < 64 ? (long long)((unsigned long long)" + x + " << " + y + ") : 0"; break;
+        case OpType::Shr: e = "(unsigned long long)" + y + " < 64 ? " + x + " >> " + y + " : (" + x + " < 0 ? -1 : 0)"; break;
+        case OpType::LogAnd: e = "(" + x + " != 0) & (" + y + " != 0)"; break;
+        case OpType::LogOr: e = "(" + x + " != 0) | (" + y + " != 0)"; break;
+        case OpType::LogNot: e = x + " == 0"; break;
+        case OpType::Eq: e = x + " == " + y; break;
+        case OpType::Ne: e = x + " != " + y; break;
+        case OpType::Lt: e = x + " < " + y; break;
+        case OpType::Le: e = x + " <= " + y; break;
+        case OpType::Gt: e = x + " > " + y; break;
+        case OpType::Ge: e = x + " >= " + y; break;
+        case OpType::Select: e = x + " != 0 ? " + y + " : " + z; break;
+        case OpType::MemRead: e = "(unsigned long long)" + x + " < (unsigned long long)" + z + " ? v[" + std::to_string(op.b) + " + " + x + "] : 0"; break;
+    }
+    return "    " + slot_ref(op.dst) + " = (long long)(" + e + ");\n";
+}
+
+// Guarded cones become nested `if` blocks; functions are only split
+// between top-level steps, so no block spans two of them.
+static size_t emit_lazy(std::ostream& out, const Netlist& nl, const std::vector<LazyStep>& schedule) {
+    size_t parts = 0, in_part = 0;
+    std::vector<size_t> block_end;
+    for (size_t k = 0; k < schedule.size(); ++k) {
+        if (block_end.empty() && (k == 0 || in_part >= kOpsPerFunction)) {
+            if (k) out << "}\n";
+            out << "static void eval_part" << parts++ << "(long long* __restrict v) {\n";
+            in_part = 0;
+        }
+        const LazyStep& step = schedule[k];
+        if (step.op >= 0) {
+            out << emit_op(nl.ops[step.op]);
+            ++in_part;
+        } else {
+            out << "    if (" << slot_ref(step.cond) << (step.when ? " != 0" : " == 0") << ") {\n";
+            block_end.push_back(k + step.skip);
+        }
+        while (!block_end.empty() && block_end.back() == k) {
+            out << "    }\n";
+            block_end.pop_back();
+        }
+    }
+    if (parts) out << "}\n";
+    return parts;
+}
+
+std::string emit_cpp(const Netlist& nl, const std::vector<LazyStep>& schedule, size_t first_op, bool commits) {
+    std::ostringstream out;
+    size_t parts = 0;
+    if (!schedule.empty()) {
+        parts = emit_lazy(out, nl, schedule);
+    } else {
+        size_t n = nl.ops.size() - std::min(first_op, nl.ops.size());
+        parts = (n + kOpsPerFunction - 1) / kOpsPerFunction;
+        for (size_t p = 0; p < parts; ++p) {
+            out << "static void eval_part" << p << "(long long* __restrict v) {\n";
+            for (size_t i = first_op + p * kOpsPerFunction; i < nl.ops.size() && i < first_op + (p + 1) * kOpsPerFunction; ++i) out << emit_op(nl.ops[i]);
+            out << "}\n";
+        }
+    }
+
+    out << "extern \"C\" void circuit_eval(long long* __restrict v) {\n";
+    for (size_t p = 0; p < parts; ++p) out << "    eval_part" << p << "(v);\n";
+    out << "}\n";
+    if (!commits) return out.str();
+
+    // Two-phase commit: read every next value into a local before writing any state slot.
+    // A patch module's commits are a table walked by a loop instead, which
+    // builds in a fraction of the time of straight-line code.
+    size_t n = nl.commits.size();
+    bool table = first_op > 0 && n > 0;
+    if (table) {
+        for (const char* field : {"src", "dst", "gate"}) {
+            out << "static const int commit_" << field << "[" << n << "] = {";
+            for (size_t i = 0; i < n; ++i) {
+                const Commit& c = nl.commits[i];
+                out << (i ? "," : "") << (field[0] == 's' ? c.src : field[0] == 'd' ? c.dst : c.gate);
+            }
+            out << "};\n";
+        }
+    }
+    out << "extern \"C\" void circuit_commit(long long* __restrict v) {\n";
+    if (table) {
+        out << "    static thread_local long long next[" << n << "];\n"
+            << "    for (int i = 0; i < " << n << "; ++i) {\n"
+            << "        int g = commit_gate[i];\n"
+            << "        next[i] = g < 0 || v[g] != 0 ? v[commit_src[i]] : v[commit_dst[i]];\n"
+            << "    }\n";
+    }
+    for (size_t i = 0; i < n && !table; ++i) {
+        const Commit& c = nl.commits[i];
+        out << "    long long n" << i << " = ";
+        if (c.gate >= 0) out << slot_ref(c.gate) << " != 0 ? " << slot_ref(c.src) << " : " << slot_ref(c.dst) << ";\n";
+        else out << slot_ref(c.src) << ";\n";
+    }
+    for (size_t i = 0; i < nl.mem_writes.size(); ++i) {
+        const MemWrite& w = nl.mem_writes[i];
+        out << "    unsigned long long a" << i << " = " << slot_ref(w.addr) << ";\n"
+            << "    bool e" << i << " = " << slot_ref(w.enable) << " != 0 && a" << i << " < " << w.depth << "ull;\n"
+            << "    long long m" << i << " = " << slot_ref(w.data) << ";\n";
+    }
+    if (table) out << "    for (int i = 0; i < " << n << "; ++i) v[commit_dst[i]] = next[i];\n";
+    for (size_t i = 0; i < n && !table; ++i) out << "    " << slot_ref(nl.commits[i].dst) << " = n" << i << ";\n";
+    for (size_t i = 0; i < nl.mem_writes.size(); ++i) {
+        out << "    if (e" << i << ") v[" << nl.mem_writes[i].base << " + a" << i << "] = m" << i << ";\n";
+    }
+    out << "}\n";
+
+    out << "extern \"C\" void circuit_run(long long* __restrict v, long long cycles) {\n"
+        << "    for (long long t = 0; t < cycles; ++t) { circuit_eval(v); circuit_commit(v); }\n"
+        << "}\n";
+    return out.str();
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::ostringstream s;
+    s << in.rdbuf();
+    return s.str();
+}
+
+JitModule::JitModule(const Netlist& nl, const std::vector<LazyStep>& schedule) { load(emit_cpp(nl, schedule)); }
+
+JitModule::JitModule(const Netlist& nl, std::shared_ptr<const JitModule> base, size_t first_op, bool commits): base_(std::move(base)) {
+    load(emit_cpp(nl, {}, first_op, commits));
+}
+
+// 128-bit key of a build: two FNV-1a passes with different offsets and primes.
+static std::string build_key(const std::string& command, const std::string& source) {
+    uint64_t h1 = 14695981039346656037ull, h2 = 0x6c62272e07bb0142ull;
+    for (const std::string* s : {&command, &source}) {
+        for (unsigned char ch : *s) {
+            h1 = (h1 ^ ch) * 1099511628211ull;
+            h2 = (h2 ^ ch) * 0x100000001b3ull ^ (h2 >> 29);
+        }
+        h1 = (h1 ^ 0xff) * 1099511628211ull;
+    }
+    char key[40];
+    std::snprintf(key, sizeof key, "%016llx%016llx", static_cast<unsigned long long>(h1), static_cast<unsigned long long>(h2));
+    return key;
+}
+
+// The cache directory, created private to this user, or "" if it is off,
+// cannot be created, or may be writable by someone else.
+static std::string cache_dir(const std::string& tmp) {
+    const char* off = std::getenv("CIRCUIT_JIT_CACHE");
+    if (off && std::string(off) == "0") return {};
+    std::string dir = tmp + "/circuit-jit-cache-" + std::to_string(geteuid());
+    ::mkdir(dir.c_str(), 0700);
+    struct stat st;
+    if (::lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 022)) return {};
+    return dir;
+}
+
+void JitModule::load(const std::string& source) {
+    const char* tmp_env = std::getenv("TMPDIR");
+    std::string tmp = tmp_env && *tmp_env ? tmp_env : "/tmp";
+    const char* cxx = std::getenv("CIRCUIT_JIT_CXX");
+    std::string compiler = std::string(cxx && *cxx ? cxx : "c++") + " -std=c++17 -O2 -fPIC -shared -w";
+
+    // A build of the same source with the same command is reused.
+    std::string cache = cache_dir(tmp);
+    std::string cached = cache.empty() ? std::string() : cache + "/" + build_key(compiler, source) + ".so";
+    if (!cached.empty() && ::access(cached.c_str(), R_OK) == 0) {
+        handle_ = dlopen(cached.c_str(), RTLD_NOW | RTLD_LOCAL);
+        // A damaged entry is built again.
+        if (!handle_) std::remove(cached.c_str());
+    }
+
+    if (!handle_) {
+        std::string dir_template = tmp + "/circuit-jit-XXXXXX";
+        if (!mkdtemp(&dir_template[0])) throw std::runtime_error("jit: cannot create a temporary directory");
+        std::string src = dir_template + "/circuit.cpp";
+        std::string lib = dir_template + "/circuit.so";
+        std::string log = dir_template + "/build.log";
+
+        {
+            std::ofstream out(src);
+            out << source;
+            if (!out) throw std::runtime_error("jit: cannot write " + src);
+        }
+
+        std::string cmd = compiler + " -o '" + lib + "' '" + src + "' > '" + log + "' 2>&1";
+        int rc = std::system(cmd.c_str());
+        std::string build_log = rc == 0 ? std::string() : read_file(log);
+        // Publish the finished object with a rename, so concurrent builds of
+        // the same source never see a partial file.
+        if (rc == 0 && !cached.empty() && std::rename(lib.c_str(), cached.c_str()) == 0) lib = cached;
+        if (rc == 0) handle_ = dlopen(lib.c_str(), RTLD_NOW | RTLD_LOCAL);
+        std::string dl_error = !handle_ && rc == 0 ? std::string(dlerror()) : std::string();
+
+        // The loaded image no longer needs its files.
+        std::remove(src.c_str());
+        if (lib != cached) std::remove(lib.c_str());
+        std::remove(log.c_str());
+        rmdir(dir_template.c_str());
+
+        if (rc != 0) throw std::runtime_error("jit: compiling generated code failed:\n" + build_log);
+        if (!handle_) throw std::runtime_error("jit: cannot load generated code: " + dl_error);
+    }
+
+    eval_ = reinterpret_cast<void (*)(long long*)>(dlsym(handle_, "circuit_eval"));
+    commit_ = reinterpret_cast<void (*)(long long*)>(dlsym(handle_, "circuit_commit"));
+    run_ = reinterpret_cast<void (*)(long long*, long long)>(dlsym(handle_, "circuit_run"));
+    if (!eval_ || (!base_ && (!commit_ || !run_))) {
+        dlclose(handle_);
+        throw std::runtime_error("jit: generated code is missing its entry points");
+    }
+}
+
+JitModule::~JitModule() {
+    if (handle_) dlclose(handle_);
+}
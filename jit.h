@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "netlist.h"
+
+// C++ source for a netlist: straight-line functions over the slot array, or,
+// given a lazy_schedule(), ones with the guarded cones inside `if` blocks.
+//   circuit_eval(v)       evaluates every op once (or the scheduled ones)
+//   circuit_commit(v)     applies the clock-edge commits
+//   circuit_run(v, n)     n full cycles of eval + commit
+// Without a schedule, circuit_eval only covers ops from `first_op` on, and
+// `commits` false leaves circuit_commit and circuit_run out.
+std::string emit_cpp(const Netlist& nl, const std::vector<LazyStep>& schedule = {}, size_t first_op = 0, bool commits = true);
+
+// A netlist compiled to native code. The generated source is built into a
+// shared object with the system C++ compiler and loaded with dlopen. The
+// compiler is taken from $CIRCUIT_JIT_CXX, falling back to `c++`. Built
+// objects are kept in $TMPDIR/circuit-jit-cache-<uid>, keyed by a hash of
+// the source and the compiler command, so the same code is only built once;
+// CIRCUIT_JIT_CACHE=0 turns the cache off.
+class JitModule {
+public:
+    // Throws std::runtime_error if the generated code cannot be built or loaded.
+    explicit JitModule(const Netlist& nl, const std::vector<LazyStep>& schedule = {});
+    // Code for a netlist patched by patch_netlist(): only the ops from
+    // `first_op` on are compiled, and they run after `base`'s, which must
+    // have been built for the netlist before patching. The commits are only
+    // compiled again if `commits` says the patch changed them.
+    JitModule(const Netlist& nl, std::shared_ptr<const JitModule> base, size_t first_op, bool commits);
+    ~JitModule();
+
+    JitModule(const JitModule&) = delete;
+    JitModule& operator=(const JitModule&) = delete;
+
+    void eval(long long* v) const {
+        if (base_) base_->eval(v);
+        eval_(v);
+    }
+    void commit(long long* v) const { commit_ ? commit_(v) : base_->commit(v); }
+    void run(long long* v, long long cycles) const {
+        if (!base_) { run_(v, cycles); return; }
+        for (long long t = 0; t < cycles; ++t) { eval(v); commit(v); }
+    }
+
+private:
+    void load(const std::string& source);
+
+    std::shared_ptr<const JitModule> base_;
+    void* handle_ {nullptr};
+    void (*eval_)(long long*) {nullptr};
+    void (*commit_)(long long*) {nullptr};
+    void (*run_)(long long*, long long) {nullptr};
+};
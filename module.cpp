@@ -0,0 +1,136 @@
+#include "module.h"
+#include "batch.h"
+#include "simulator.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Instances per task when the array is split across threads.
+static const int kInstanceGrain = 256;
+
+ModuleArray::ModuleArray(const Module& module, int instances, const CompileOptions& options, int threads)
+    : nl_(compile_netlist(module.body().wires(), options)), instances_(instances) {
+    if (instances_ < 1) throw std::invalid_argument("module array needs at least one instance");
+    if (has_wide_signals(nl_)) throw std::invalid_argument("module arrays do not support signals wider than 64 bits");
+    for (size_t i = 0; i < nl_.wires.size(); ++i) index_.emplace(nl_.wires[i], i);
+
+    from_input_.assign(nl_.init.size(), 0);
+    for (const Wire* in : module.inputs()) {
+        if (in->comb_expr || in->next_expr) throw std::invalid_argument("input port '" + in->name + "' of module '" + module.name() + "' must not be driven");
+        from_input_[nl_.wire_slot[index_of(*in)]] = 1;
+    }
+    // Levelized order puts every op after its operands, so one pass marks the
+    // input-dependent cone and both halves keep a valid order.
+    for (const FlatOp& op : nl_.ops) {
+        from_input_[op.dst] = from_input_[op.a] | from_input_[op.b] | from_input_[op.c];
+        (from_input_[op.dst] ? post_ : pre_).push_back(op);
+    }
+
+    staged_.resize(nl_.commits.size() * static_cast<size_t>(instances_));
+    if (threads > 1 && instances_ >= 2 * kInstanceGrain) pool_.reset(new ThreadPool(threads));
+    reset();
+}
+
+ModuleArray::~ModuleArray() = default;
+
+size_t ModuleArray::index_of(const Wire& w) const {
+    auto it = index_.find(&w);
+    if (it == index_.end()) throw std::invalid_argument("wire '" + w.name + "' is not part of this module");
+    return it->second;
+}
+
+void ModuleArray::check_instance(int i) const {
+    if (i < 0 || i >= instances_) throw std::out_of_range("instance out of range");
+}
+
+void ModuleArray::connect(int dst, const Wire& input, int src, const Wire& output) {
+    check_instance(dst);
+    check_instance(src);
+    size_t in = index_of(input);
+    int in_slot = nl_.wire_slot[in];
+    if (!nl_.pokeable[in] || !from_input_[in_slot] || nl_.state_slot[in] != in_slot) {
+        throw std::invalid_argument("wire '" + input.name + "' is not an input port");
+    }
+    int out_slot = nl_.wire_slot[index_of(output)];
+    if (from_input_[out_slot]) {
+        throw std::invalid_argument("output '" + output.name + "' depends combinationally on an input port and cannot feed another instance");
+    }
+    Connection c {in_slot, dst, out_slot, src, width_mask(nl_.slot_width[in_slot])};
+    for (Connection& e : connections_) {
+        if (e.dst == dst && e.dst_slot == in_slot) { e = c; evaluated_ = false; return; }
+    }
+    connections_.push_back(c);
+    evaluated_ = false;
+}
+
+void ModuleArray::eval_ops(const std::vector<FlatOp>& ops) {
+    auto range = [&](int b, int e) {
+        for (const FlatOp& op : ops) {
+            if (op.op == OpType::MemRead) eval_mem_read_lanes(op, v_.data(), instances_, b, e);
+            else eval_lanes(op.op, slot(op.dst) + b, slot(op.a) + b, slot(op.b) + b, slot(op.c) + b, e - b);
+        }
+    };
+    if (!pool_) { range(0, instances_); return; }
+    size_t tasks = (static_cast<size_t>(instances_) + kInstanceGrain - 1) / kInstanceGrain;
+    pool_->parallel_for(tasks, [&](size_t k) {
+        int b = static_cast<int>(k) * kInstanceGrain;
+        range(b, std::min(instances_, b + kInstanceGrain));
+    });
+}
+
+void ModuleArray::evaluate() {
+    if (evaluated_) return;
+    eval_ops(pre_);
+    for (const Connection& c : connections_) slot(c.dst_slot)[c.dst] = slot(c.src_slot)[c.src] & c.mask;
+    eval_ops(post_);
+    evaluated_ = true;
+}
+
+void ModuleArray::commit() {
+    // Two-phase commit: read every next value before any state slot changes.
+    for (size_t i = 0; i < nl_.commits.size(); ++i) stage_commit(nl_.commits[i], v_.data(), instances_, staged_.data() + i * instances_);
+    stage_mem_writes(nl_.mem_writes, v_.data(), instances_, mem_staged_);
+    for (size_t i = 0; i < nl_.commits.size(); ++i) {
+        auto src = staged_.begin() + static_cast<std::ptrdiff_t>(i * instances_);
+        std::copy(src, src + instances_, slot(nl_.commits[i].dst));
+    }
+    apply_mem_writes(mem_staged_, v_.data(), instances_);
+    evaluated_ = false;
+    ++cycle_;
+}
+
+void ModuleArray::step() {
+    evaluate();
+    commit();
+}
+
+void ModuleArray::run(int cycles) {
+    for (int t = 0; t < cycles; ++t) step();
+}
+
+void ModuleArray::reset() {
+    v_.resize(nl_.init.size() * static_cast<size_t>(instances_));
+    for (size_t s = 0; s < nl_.init.size(); ++s) std::fill_n(slot(static_cast<int>(s)), instances_, nl_.init[s]);
+    cycle_ = 0;
+    evaluated_ = false;
+}
+
+void ModuleArray::poke(const Wire& w, int instance, long long value) {
+    size_t i = index_of(w);
+    check_instance(instance);
+    if (!nl_.pokeable[i]) throw std::invalid_argument(not_pokeable_message(w));
+    int s = nl_.wire_slot[i];
+    for (const Connection& c : connections_) {
+        if (c.dst == instance && c.dst_slot == s) throw std::invalid_argument("input port '" + w.name + "' is connected and cannot be poked");
+    }
+    slot(s)[instance] = value & width_mask(nl_.slot_width[s]);
+    evaluated_ = false;
+}
+
+long long ModuleArray::peek(const Wire& w, int instance) {
+    size_t i = index_of(w);
+    check_instance(instance);
+    evaluate();
+    return slot(nl_.wire_slot[i])[instance];
+}
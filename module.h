@@ -0,0 +1,128 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "circuit.h"
+#include "netlist.h"
+
+class ThreadPool;
+
+// A reusable block: a body built once from its own wires, with input ports
+// (undriven wires whose value comes from outside each cycle) and output
+// ports other instances may read. Expressions over the body's wires are
+// built in the module's own arena:
+//
+//     Module core("core");
+//     Wire& in = core.input("in");
+//     Wire& acc = core.wire("acc");
+//     acc << acc + in;
+//     core.output(acc);
+class Module {
+public:
+    explicit Module(std::string name): name_(std::move(name)) {}
+    Module(const Module&) = delete;
+    Module& operator=(const Module&) = delete;
+
+    const std::string& name() const { return name_; }
+    ExprArena& arena() { return body_.arena(); }
+    const Circuit& body() const { return body_; }
+
+    // An input port. It must stay undriven: its value is poked or copied
+    // from a connected output every cycle.
+    Wire& input(const std::string& name, int width = 64) {
+        Wire& w = body_.wire(name, 0, width);
+        inputs_.push_back(&w);
+        return w;
+    }
+    Wire& wire(const std::string& name, long long init = 0, int width = 64) { return body_.wire(name, init, width); }
+    // Makes a body wire readable by other instances.
+    void output(const Wire& w) { outputs_.push_back(&w); }
+
+    const std::vector<const Wire*>& inputs() const { return inputs_; }
+    const std::vector<const Wire*>& outputs() const { return outputs_; }
+
+private:
+    std::string name_;
+    Circuit body_;
+    std::vector<const Wire*> inputs_;
+    std::vector<const Wire*> outputs_;
+};
+
+// `instances` copies of one module compiled once. Every slot of the body
+// holds one value per instance contiguously, so each op is a loop over the
+// instances that the compiler vectorizes and that splits cleanly across
+// threads; per-instance cost is only the slot storage.
+//
+// Instances talk through connect(): each cycle the ops that do not depend
+// on any input port run first, connected outputs are copied to their input
+// ports, then the input-dependent ops run before the clock edge. Outputs
+// used in connections must therefore not depend combinationally on an
+// input port (a registered output always qualifies).
+//
+// Instancing is one level deep. A module body cannot instantiate another
+// module, and an array cannot be placed inside a parent Circuit next to
+// glue logic: the array is simulated on its own, and connect() is the only
+// way values cross instances, as a plain copy from an output port to an
+// input port. Logic between instances has to be part of the body. Arrays
+// evaluate on their own interpreter loop, without Simulator's engines
+// (JIT, event-driven, lazy), sinks, probes or checkpoints.
+class ModuleArray {
+public:
+    // `threads` counts the calling thread. Throws std::invalid_argument if an
+    // input port is driven or a body signal is wider than 64 bits.
+    ModuleArray(const Module& module, int instances, const CompileOptions& options = {}, int threads = 1);
+    ~ModuleArray();
+
+    int instances() const { return instances_; }
+
+    // Instance `dst`'s input port `input` takes instance `src`'s `output` in
+    // every cycle. Replaces an earlier connection of the same input. Throws
+    // std::invalid_argument if `output` depends combinationally on an input.
+    void connect(int dst, const Wire& input, int src, const Wire& output);
+
+    void step();
+    void run(int cycles);
+    // Every instance returns to the body's initial values; connections stay.
+    void reset();
+
+    // Set an unconnected input port or a register of one instance.
+    void poke(const Wire& w, int instance, long long value);
+    long long peek(const Wire& w, int instance);
+
+    const Netlist& netlist() const { return nl_; }
+    long long cycle() const { return cycle_; }
+
+private:
+    struct Connection {
+        int dst_slot;
+        int dst;
+        int src_slot;
+        int src;
+        long long mask;
+    };
+
+    size_t index_of(const Wire& w) const;
+    void check_instance(int i) const;
+    long long* slot(int s) { return v_.data() + static_cast<size_t>(s) * instances_; }
+    void eval_ops(const std::vector<FlatOp>& ops);
+    void evaluate();
+    void commit();
+
+    Netlist nl_;
+    int instances_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<FlatOp> pre_;     // ops independent of the input ports
+    std::vector<FlatOp> post_;    // ops reading an input port, directly or not
+    std::vector<char> from_input_; // per slot: depends on an input port this cycle
+    std::vector<Connection> connections_;
+    std::unordered_map<const Wire*, size_t> index_;
+    std::vector<long long> v_;
+    std::vector<long long> staged_;
+    std::vector<std::pair<int, long long>> mem_staged_;
+    long long cycle_ {0};
+    bool evaluated_ {false};
+};
@@ -0,0 +1,898 @@
+#include "netlist.h"
+#include "wide.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+static void push_expr_wires(const ExprNode* n, std::vector<const ExprNode*>& stack) {
+    if (n) stack.push_back(n);
+}
+
+// All wires reachable from the targets and the probe expressions through
+// comb_expr, next_expr and enable_expr, and through the write ports of
+// memories they read, in discovery order.
+static std::vector<const Wire*> closure_from_targets(const std::vector<const Wire*>& targets, const std::vector<Expr>& probes) {
+    std::unordered_set<const Wire*> seen;
+    std::unordered_set<const Memory*> seen_memories;
+    // Nodes are shared, so without this a chain of If()s over the same
+    // subexpression would be walked once per path, exponentially often.
+    std::unordered_set<const ExprNode*> seen_nodes;
+    std::vector<const Wire*> order;
+    std::vector<const ExprNode*> stack;
+    auto visit = [&](const Wire* w) {
+        if (!w || !seen.insert(w).second) return;
+        order.push_back(w);
+        push_expr_wires(w->enable_expr, stack);
+        push_expr_wires(w->next_expr, stack);
+        push_expr_wires(w->comb_expr, stack);
+    };
+    for (const Wire* w : targets) visit(w);
+    for (size_t i = probes.size(); i-- > 0;) push_expr_wires(probes[i].node, stack);
+    while (!stack.empty()) {
+        const ExprNode* n = stack.back();
+        stack.pop_back();
+        if (!seen_nodes.insert(n).second) continue;
+        if (n->op == OpType::WireRef) { visit(n->wire); continue; }
+        if (n->op == OpType::MemRead && seen_memories.insert(n->memory).second) {
+            for (const Memory::WritePort& p : n->memory->write_ports) {
+                push_expr_wires(p.enable, stack);
+                push_expr_wires(p.data, stack);
+                push_expr_wires(p.addr, stack);
+            }
+        }
+        push_expr_wires(n->c, stack);
+        push_expr_wires(n->b, stack);
+        push_expr_wires(n->a, stack);
+    }
+    return order;
+}
+
+// One step of the lowering schedule: a wire or an expression node.
+struct ScheduleItem {
+    const Wire* wire;
+    const ExprNode* node;
+};
+
+// Iterative depth-first search over the combinational dependency graph: a
+// wire depends on its comb_expr, a WireRef node on its wire and other nodes
+// on their operands. Each add() appends the post-order of what it reaches,
+// so the order lists each wire and node after everything it reads within
+// the cycle, and lowering in that order never recurses. Memory cells are
+// state, so a MemRead only depends on its address. Reaching a vertex that
+// is still on the stack means a combinational loop, which is reported with
+// the wires along it. Given `expand`, only those wires are searched through;
+// any other is a leaf whose slot is already known.
+class CombSearch {
+public:
+    explicit CombSearch(const std::unordered_set<const Wire*>* expand = nullptr): expand_(expand) {}
+
+    void add(const Wire* w, const ExprNode* n) {
+        push(w, n);
+        run();
+    }
+
+    std::vector<ScheduleItem> order;
+    std::vector<const Memory*> memories; // read by the nodes reached, in discovery order
+
+private:
+    struct Frame {
+        ScheduleItem item;
+        int next;
+    };
+
+    static const void* key_of(const ScheduleItem& it) {
+        return it.wire ? static_cast<const void*>(it.wire) : static_cast<const void*>(it.node);
+    }
+
+    void push(const Wire* w, const ExprNode* n) {
+        const void* key = key_of(ScheduleItem{w, n});
+        char& st = state_[key];
+        if (st == 2) return;
+        if (st == 1) {
+            std::string path;
+            size_t k = stack_.size();
+            while (k-- > 0) {
+                if (key_of(stack_[k].item) == key) break;
+            }
+            const Wire* first = nullptr;
+            for (; k < stack_.size(); ++k) {
+                const Wire* sw = stack_[k].item.wire;
+                if (!sw) continue;
+                if (!first) first = sw;
+                path += sw->name + " -> ";
+            }
+            throw std::invalid_argument("combinational loop: " + path + (first ? first->name : std::string("?")));
+        }
+        st = 1;
+        if (n && n->op == OpType::MemRead && seen_memories_.insert(n->memory).second) memories.push_back(n->memory);
+        stack_.push_back(Frame{ScheduleItem{w, n}, 0});
+    }
+
+    void run() {
+        while (!stack_.empty()) {
+            Frame& f = stack_.back();
+            int k = f.next++;
+            const Wire* cw = nullptr;
+            const ExprNode* cn = nullptr;
+            if (f.item.wire) {
+                // Constant drivers are leaves: lower_wire() gives them their own slot or folds them.
+                const ExprNode* e = f.item.wire->comb_expr;
+                if (k == 0 && e && e->op != OpType::Constant && (!expand_ || expand_->count(f.item.wire))) cn = e;
+            } else if (f.item.node->op == OpType::WireRef) {
+                if (k == 0) cw = f.item.node->wire;
+            } else if (k < 3) {
+                const ExprNode* n = f.item.node;
+                cn = k == 0 ? n->a : k == 1 ? n->b : n->c;
+                if (!cn) continue;
+            }
+            if (cw || cn) { push(cw, cn); continue; }
+            ScheduleItem done = f.item;
+            stack_.pop_back();
+            state_[key_of(done)] = 2;
+            order.push_back(done);
+        }
+    }
+
+    const std::unordered_set<const Wire*>* expand_;
+    std::unordered_map<const void*, char> state_; // 1 on the stack, 2 finished
+    std::vector<Frame> stack_;
+    std::unordered_set<const Memory*> seen_memories_;
+};
+
+// Lowering order for a whole circuit. Roots are every wire, next_expr and
+// enable_expr and the probe expressions; write-port expressions of the
+// memories read are extra roots, like next_expr.
+static std::vector<ScheduleItem> comb_schedule(const std::vector<const Wire*>& wires, const std::vector<Expr>& probes) {
+    CombSearch search;
+    for (const Wire* w : wires) search.add(w, nullptr);
+    for (const Wire* w : wires) {
+        if (!w->next_expr) continue;
+        search.add(nullptr, w->next_expr);
+        if (w->enable_expr) search.add(nullptr, w->enable_expr);
+    }
+    for (const Expr& p : probes) search.add(nullptr, p.node);
+    // Write ports can read further memories, so the list may grow.
+    for (size_t m = 0; m < search.memories.size(); ++m) {
+        for (const Memory::WritePort& p : search.memories[m]->write_ports) {
+            for (const ExprNode* e : {p.addr, p.data, p.enable}) search.add(nullptr, e);
+        }
+    }
+    return std::move(search.order);
+}
+
+// Bits needed for a constant; negative values need all 64.
+static int value_width(long long v) {
+    if (v < 0) return 64;
+    int w = 1;
+    while (w < 64 && (v >> w) != 0) ++w;
+    return w;
+}
+
+// Result width of an op given operand widths. A width below 64 means the
+// value is known to lie in [0, 2^width); 64 means any long long. Above 64
+// the value is unsigned and ops wrap at the widest operand.
+static int infer_width(OpType op, int wa, int wb, int wc) {
+    bool unary = op == OpType::BitNot || op == OpType::Neg || op == OpType::LogNot;
+    if (unary ? wa > 64 : op == OpType::Select ? std::max(wb, wc) > 64 : std::max(wa, wb) > 64) {
+        switch (op) {
+            case OpType::BitNot: case OpType::Neg: return wa;
+            case OpType::BitAnd: return (wa < 64 || wb < 64) ? std::min(wa, wb) : std::max(wa, wb);
+            case OpType::Shl: case OpType::Shr: return std::max(wa, 64);
+            case OpType::LogAnd: case OpType::LogOr: case OpType::LogNot:
+            case OpType::Eq: case OpType::Ne: case OpType::Lt: case OpType::Le: case OpType::Gt: case OpType::Ge: return 1;
+            case OpType::Select: return std::max(wb, wc);
+            default: return std::max(wa, wb);
+        }
+    }
+    bool narrow = wa < 64 && wb < 64;
+    switch (op) {
+        case OpType::Add: return narrow ? std::min(64, std::max(wa, wb) + 1) : 64;
+        case OpType::Mul: return !narrow ? 64 : (wa == 1 && wb == 1) ? 1 : std::min(64, wa + wb);
+        case OpType::Div: return narrow ? wa : 64;
+        case OpType::Mod: return narrow ? std::min(wa, wb) : 64;
+        case OpType::BitAnd: return std::min(wa, wb);
+        case OpType::BitOr:
+        case OpType::BitXor: return std::max(wa, wb);
+        case OpType::Shr: return wa;
+        case OpType::LogAnd: case OpType::LogOr: case OpType::LogNot:
+        case OpType::Eq: case OpType::Ne: case OpType::Lt: case OpType::Le: case OpType::Gt: case OpType::Ge: return 1;
+        case OpType::Select: return std::max(wb, wc);
+        case OpType::MemRead: return wb;
+        default: return 64;
+    }
+}
+
+namespace {
+
+struct Lowering {
+    Netlist& nl;
+    const CompileOptions& options;
+    std::vector<int> slot_level;
+    std::vector<char> slot_const;  // slot holds a value that never changes
+    std::vector<int> slot_op;      // index into nl.ops of the op writing the slot, -1 for leaves
+    std::unordered_set<const Wire*> inputs;
+    std::unordered_map<const Wire*, int> wire_value;
+    std::unordered_map<const ExprNode*, int> node_slot;
+    std::unordered_map<long long, int> const_slot;
+    std::unordered_map<const Memory*, int> memory_slot;
+    std::unordered_map<const Clock*, int> clock_tick;
+
+    Lowering(Netlist& n, const CompileOptions& o): nl(n), options(o), inputs(o.inputs.begin(), o.inputs.end()) {}
+
+    // A wide slot spans one entry per word; `init` is sign-extended into them.
+    int new_slot(long long init, int level, int width = 64) {
+        int first = static_cast<int>(nl.init.size());
+        WideValue value(init, std::max(width, 64));
+        for (int k = 0; k < WideValue::words_for(width); ++k) {
+            nl.init.push_back(width > 64 ? static_cast<long long>(value.words[k]) : init);
+            nl.slot_width.push_back(static_cast<unsigned short>(width));
+            slot_level.push_back(level);
+            slot_const.push_back(0);
+            slot_op.push_back(-1);
+        }
+        return first;
+    }
+
+    int constant(long long value) {
+        if (!options.optimize) {
+            int s = new_slot(value, 0, value_width(value));
+            slot_const[s] = 1;
+            return s;
+        }
+        auto it = const_slot.find(value);
+        if (it != const_slot.end()) return it->second;
+        int s = new_slot(value, 0, value_width(value));
+        slot_const[s] = 1;
+        const_slot.emplace(value, s);
+        return s;
+    }
+
+    bool is_const(int slot, long long& value) const {
+        if (!slot_const[slot]) return false;
+        value = nl.init[slot];
+        return true;
+    }
+
+    // First cell of `m`, allocated on first use with the committed contents.
+    int memory_base(const Memory* m) {
+        auto it = memory_slot.find(m);
+        if (it != memory_slot.end()) return it->second;
+        int base = static_cast<int>(nl.init.size());
+        for (long long v : m->contents) new_slot(v, 0, m->width);
+        memory_slot.emplace(m, base);
+        nl.memories.push_back(MemoryLayout{m, base});
+        return base;
+    }
+
+    FlatOp binary(OpType type, int a, int b, int c = 0) {
+        FlatOp op;
+        op.op = type;
+        op.a = a;
+        op.b = b;
+        op.c = c;
+        return op;
+    }
+
+    // Slot that is 1 on the cycles `clk` ticks, fed by a hidden counter register.
+    int tick_of(const Clock* clk) {
+        auto it = clock_tick.find(clk);
+        if (it != clock_tick.end()) return it->second;
+        int counter = new_slot(0, 0, value_width(clk->period));
+        int tick = emit(binary(OpType::Eq, counter, constant(clk->phase)));
+        int wrap = emit(binary(OpType::Eq, counter, constant(clk->period - 1)));
+        int next = emit(binary(OpType::Select, wrap, constant(0), emit(binary(OpType::Add, counter, constant(1)))));
+        Commit c;
+        c.src = mask_to(next, nl.slot_width[counter]);
+        c.dst = counter;
+        nl.commits.push_back(c);
+        nl.clocks.push_back(ClockLayout{clk, counter, tick});
+        clock_tick.emplace(clk, tick);
+        return tick;
+    }
+
+    // Gate slot for register `w`, or -1 if it updates every cycle. With
+    // optimization a hold pattern such as `w << If(en, x, w)` becomes an
+    // enable too, and `next` is narrowed to `x`.
+    int gate_of(const Wire* w, const ExprNode*& next) {
+        int gate = -1;
+        auto require = [&](int slot) {
+            if (nl.slot_width[slot] > 64) slot = emit(binary(OpType::Ne, slot, constant(0)));
+            long long value = 0;
+            if (is_const(slot, value) && value != 0) return;
+            gate = gate < 0 ? slot : emit(binary(OpType::LogAnd, gate, slot));
+        };
+        if (w->clock && w->clock->period > 1) require(tick_of(w->clock));
+        if (w->enable_expr) require(lower_node(w->enable_expr));
+        // Without a comb driver a WireRef to `w` reads its committed value, so
+        // selecting it holds the register.
+        auto holds = [w](const ExprNode* n) { return n->op == OpType::WireRef && n->wire == w; };
+        while (options.optimize && !w->comb_expr && next->op == OpType::Select && holds(next->c) != holds(next->b)) {
+            int cond = lower_node(next->a);
+            if (holds(next->c)) {
+                require(cond);
+                next = next->b;
+            } else {
+                require(emit(binary(OpType::Eq, cond, constant(0))));
+                next = next->c;
+            }
+        }
+        return gate;
+    }
+
+    bool is_pokeable(const Wire* w) const {
+        if (!w->comb_expr) return true;
+        return w->comb_expr->op == OpType::Constant && (!options.optimize || inputs.count(w));
+    }
+
+    int lower_wire(const Wire* w) {
+        auto it = wire_value.find(w);
+        if (it != wire_value.end()) return it->second;
+        // A wire without a combinational driver reads its committed state. A
+        // constant-driven input gets a slot of its own so it can be poked;
+        // other constant-driven wires are folded into their readers.
+        int slot;
+        if (!w->comb_expr) slot = new_slot(w->committed_value & width_mask(w->width), 0, w->width);
+        else if (is_pokeable(w)) slot = new_slot(w->comb_expr->constant_value & width_mask(w->width), 0, w->width);
+        else slot = mask_to(lower_node(w->comb_expr), w->width);
+        wire_value.emplace(w, slot);
+        return slot;
+    }
+
+    // `slot` as a `width`-bit value: truncated when it may not fit, and
+    // widened to a multi-word slot for wide wires. No op is needed when the
+    // slot already has that shape.
+    int mask_to(int slot, int width) {
+        int have = nl.slot_width[slot];
+        if (width > 64 || have > 64) {
+            if (have == width) return slot;
+            // The wide op's result width does the truncation or extension.
+            FlatOp op;
+            op.op = OpType::BitOr;
+            op.a = slot;
+            op.b = constant(0);
+            return emit(op, width);
+        }
+        if (have <= width || width == 64) return slot;
+        FlatOp op;
+        op.op = OpType::BitAnd;
+        op.a = slot;
+        op.b = constant(width_mask(width));
+        int s = options.optimize ? simplify(op) : -1;
+        return s < 0 ? emit(op) : s;
+    }
+
+    int lower_node(const ExprNode* n) {
+        auto it = node_slot.find(n);
+        if (it != node_slot.end()) return it->second;
+        int slot;
+        if (n->op == OpType::Constant) {
+            slot = constant(n->constant_value);
+        } else if (n->op == OpType::WireRef) {
+            slot = lower_wire(n->wire);
+        } else if (n->op == OpType::MemRead) {
+            FlatOp op;
+            op.op = OpType::MemRead;
+            op.a = mask_to(lower_node(n->a), 64);
+            op.b = memory_base(n->memory);
+            op.c = constant(n->memory->depth);
+            slot = emit(op);
+        } else {
+            FlatOp op;
+            op.op = n->op;
+            if (n->a) op.a = lower_node(n->a);
+            if (n->b) op.b = lower_node(n->b);
+            if (n->c) op.c = lower_node(n->c);
+            slot = options.optimize ? simplify(op) : -1;
+            if (slot < 0) slot = emit(op);
+        }
+        node_slot.emplace(n, slot);
+        return slot;
+    }
+
+    // `width` overrides the inferred result width (0 keeps it).
+    int emit(FlatOp op, int width = 0) {
+        int level = std::max(slot_level[op.a], std::max(slot_level[op.b], slot_level[op.c]));
+        int wa = nl.slot_width[op.a], wb = nl.slot_width[op.b], wc = nl.slot_width[op.c];
+        int result = width ? width : infer_width(op.op, wa, wb, wc);
+        bool unary = op.op == OpType::BitNot || op.op == OpType::Neg || op.op == OpType::LogNot;
+        int widest = std::max(result, unary ? wa : op.op == OpType::Select ? std::max(wa, std::max(wb, wc)) : std::max(wa, wb));
+        if (widest > 64) op.width = static_cast<unsigned short>(result);
+        op.dst = new_slot(0, level + 1, result);
+        slot_op[op.dst] = static_cast<int>(nl.ops.size());
+        nl.ops.push_back(op);
+        return op.dst;
+    }
+
+    // Slot that already holds the op's result, or -1 when it must be computed.
+    int simplify(const FlatOp& op) {
+        long long x = 0, y = 0, z = 0;
+        bool cx = is_const(op.a, x), cy = is_const(op.b, y), cz = is_const(op.c, z);
+        bool unary = op.op == OpType::BitNot || op.op == OpType::Neg || op.op == OpType::LogNot;
+        if (cx && (unary || (cy && (op.op != OpType::Select || cz)))) return constant(eval_op(op.op, x, y, z));
+
+        int a = op.a, b = op.b;
+        // Put a lone constant operand of a commutative op on the right.
+        if (is_commutative(op.op) && cx && !cy) { std::swap(a, b); std::swap(x, y); std::swap(cx, cy); }
+        bool same = a == b;
+        switch (op.op) {
+            case OpType::Add: if (cy && y == 0) return a; break;
+            case OpType::Sub: if (cy && y == 0) return a; if (same) return constant(0); break;
+            case OpType::Mul: if (cy && y == 0) return constant(0); if (cy && y == 1) return a; break;
+            case OpType::Div: if (cy && y == 0) return constant(0); if (cy && y == 1) return a; break;
+            case OpType::Mod:
+                // -1 is all ones, not minus one, once sign-extended into a wide operand.
+                if (cy && (y == 0 || y == 1 || (y == -1 && nl.slot_width[a] <= 64))) return constant(0);
+                break;
+            case OpType::BitAnd:
+                if (cy && y == 0) return constant(0);
+                if ((cy && y == -1) || same) return a;
+                // Truncating the complement of a narrow value: ~x & m == x ^ m when m covers x.
+                if (cy && y > 0 && (y & (y + 1)) == 0 && slot_op[a] >= 0) {
+                    const FlatOp& inner = nl.ops[slot_op[a]];
+                    if (inner.op == OpType::BitNot && nl.slot_width[inner.a] <= value_width(y)) {
+                        FlatOp x_op;
+                        x_op.op = OpType::BitXor;
+                        x_op.a = inner.a;
+                        x_op.b = b;
+                        return emit(x_op);
+                    }
+                }
+                break;
+            case OpType::BitOr:
+                if (cy && y == -1 && nl.slot_width[a] <= 64) return constant(-1);
+                if ((cy && y == 0) || same) return a;
+                break;
+            case OpType::BitXor: if (cy && y == 0) return a; if (same) return constant(0); break;
+            case OpType::Shl:
+            case OpType::Shr: if (cy && y == 0) return a; if (cx && x == 0) return constant(0); break;
+            case OpType::LogAnd: if (cy && y == 0) return constant(0); break;
+            case OpType::LogOr: if (cy && y != 0) return constant(1); break;
+            case OpType::Eq:
+            case OpType::Le:
+            case OpType::Ge: if (same) return constant(1); break;
+            case OpType::Ne:
+            case OpType::Lt:
+            case OpType::Gt: if (same) return constant(0); break;
+            case OpType::Select:
+                if (cx) return x != 0 ? op.b : op.c;
+                if (op.b == op.c) return op.b;
+                break;
+            default: break;
+        }
+        return -1;
+    }
+};
+
+} // namespace
+
+// Stable counting sort of ops[first, end) by the level of the slot they
+// write. Their levels follow those already in level_begin, which cover
+// ops[0, first).
+static void levelize(Netlist& nl, const std::vector<int>& slot_level, size_t first = 0) {
+    int max_level = 0;
+    for (size_t i = first; i < nl.ops.size(); ++i) max_level = std::max(max_level, slot_level[nl.ops[i].dst]);
+    std::vector<size_t> begin(static_cast<size_t>(max_level) + 2, first);
+    for (size_t i = first; i < nl.ops.size(); ++i) ++begin[slot_level[nl.ops[i].dst] + 1];
+    for (size_t l = 1; l < begin.size(); ++l) begin[l] += begin[l - 1] - first;
+    std::vector<size_t> fill(begin.begin(), begin.end() - 1);
+    std::vector<FlatOp> sorted(nl.ops.size());
+    std::copy(nl.ops.begin(), nl.ops.begin() + first, sorted.begin());
+    for (size_t i = first; i < nl.ops.size(); ++i) sorted[fill[slot_level[nl.ops[i].dst]]++] = nl.ops[i];
+    nl.ops.swap(sorted);
+    if (!nl.level_begin.empty()) nl.level_begin.pop_back();
+    nl.level_begin.insert(nl.level_begin.end(), begin.begin(), begin.end());
+}
+
+// Drop ops from `first` on whose results are never read, e.g. the cone of
+// `x` in `x * 0`.
+static void remove_dead_ops(Netlist& nl, size_t first = 0) {
+    std::vector<char> live(nl.init.size(), 0);
+    for (int s : nl.wire_slot) live[s] = 1;
+    for (const Commit& c : nl.commits) {
+        live[c.src] = 1;
+        if (c.gate >= 0) live[c.gate] = 1;
+    }
+    for (const MemWrite& w : nl.mem_writes) live[w.addr] = live[w.data] = live[w.enable] = 1;
+    for (int s : nl.probe_slots) live[s] = 1;
+    // Ops are emitted after their operands, so one reverse pass propagates liveness.
+    for (size_t i = nl.ops.size(); i-- > 0;) {
+        const FlatOp& op = nl.ops[i];
+        if (live[op.dst]) live[op.a] = live[op.b] = live[op.c] = 1;
+    }
+    nl.ops.erase(std::remove_if(nl.ops.begin() + first, nl.ops.end(), [&](const FlatOp& op) { return !live[op.dst]; }), nl.ops.end());
+}
+
+Netlist compile_netlist(const std::vector<const Wire*>& targets, const CompileOptions& options) {
+    for (const Expr& p : options.probes) {
+        if (!p.node) throw std::invalid_argument("probe has no expression");
+    }
+    Netlist nl;
+    nl.wires = closure_from_targets(targets, options.probes);
+    Lowering lw(nl, options);
+    // Slot 0 is a constant zero that unused operand fields point at.
+    lw.constant(0);
+
+    for (const ScheduleItem& it : comb_schedule(nl.wires, options.probes)) {
+        if (it.wire) lw.lower_wire(it.wire);
+        else lw.lower_node(it.node);
+    }
+    for (const Wire* w : nl.wires) nl.wire_slot.push_back(lw.lower_wire(w));
+    // The closure visits targets first, so each one sits at its first-seen position.
+    std::unordered_set<const Wire*> seen;
+    for (const Wire* w : targets) {
+        if (w && seen.insert(w).second) nl.targets.push_back(seen.size() - 1);
+    }
+
+    nl.state_slot.assign(nl.wires.size(), -1);
+    nl.pokeable.assign(nl.wires.size(), 0);
+    for (size_t i = 0; i < nl.wires.size(); ++i) {
+        const Wire* w = nl.wires[i];
+        nl.pokeable[i] = lw.is_pokeable(w);
+        if (!w->comb_expr) nl.state_slot[i] = nl.wire_slot[i];
+        if (!w->next_expr) continue;
+        // With both drivers the committed value is shadowed by comb_expr, but
+        // it is still tracked so it can be written back after the run.
+        if (w->comb_expr) nl.state_slot[i] = lw.new_slot(w->committed_value & width_mask(w->width), 0, w->width);
+        const ExprNode* next = w->next_expr;
+        int gate = lw.gate_of(w, next);
+        int src = lw.mask_to(lw.lower_node(next), w->width);
+        for (int k = 0; k < WideValue::words_for(w->width); ++k) {
+            Commit c;
+            c.src = src + k;
+            c.dst = nl.state_slot[i] + k;
+            c.gate = gate;
+            nl.commits.push_back(c);
+        }
+    }
+
+    // Lowering a write port can reach another memory, so the list may grow.
+    for (size_t m = 0; m < nl.memories.size(); ++m) {
+        const Memory* mem = nl.memories[m].memory;
+        for (const Memory::WritePort& p : mem->write_ports) {
+            MemWrite w;
+            w.addr = lw.mask_to(lw.lower_node(p.addr), 64);
+            w.data = lw.mask_to(lw.lower_node(p.data), mem->width);
+            w.enable = lw.mask_to(lw.lower_node(p.enable), 64);
+            w.base = nl.memories[m].base;
+            w.depth = mem->depth;
+            nl.mem_writes.push_back(w);
+        }
+    }
+
+    // Probes are tested for truth, so a wide one is reduced to a flag.
+    for (const Expr& p : options.probes) {
+        int slot = lw.lower_node(p.node);
+        if (nl.slot_width[slot] > 64) slot = lw.emit(lw.binary(OpType::Ne, slot, lw.constant(0)));
+        nl.probe_slots.push_back(slot);
+    }
+
+    if (options.optimize) remove_dead_ops(nl);
+    levelize(nl, lw.slot_level);
+    return nl;
+}
+
+bool patch_netlist(Netlist& nl, const std::vector<const Wire*>& edited, const CompileOptions& options) {
+    if (options.probes.size() != nl.probe_slots.size()) return false;
+    const size_t slots = nl.init.size(), first = nl.ops.size();
+    std::unordered_map<const Wire*, size_t> index;
+    for (size_t i = 0; i < nl.wires.size(); ++i) index.emplace(nl.wires[i], i);
+    std::vector<int> writer(slots, -1);
+    for (size_t i = 0; i < first; ++i) writer[nl.ops[i].dst] = static_cast<int>(i);
+    std::vector<int> commit_of(slots, -1);
+    for (size_t i = 0; i < nl.commits.size(); ++i) commit_of[nl.commits[i].dst] = static_cast<int>(i);
+    std::unordered_set<const Clock*> clocks;
+    for (const ClockLayout& c : nl.clocks) clocks.insert(c.clock);
+    auto has_comb = [&nl](size_t i) { return nl.state_slot[i] != nl.wire_slot[i]; };
+    auto has_next = [&nl, &commit_of](size_t i) { return nl.state_slot[i] >= 0 && commit_of[nl.state_slot[i]] >= 0; };
+
+    // Only logic may change: the slot layout, and so the state, stays as is.
+    Lowering lw(nl, options);
+    std::vector<char> tainted(slots, 0);
+    std::vector<char> relower_next(nl.wires.size(), 0);
+    for (const Wire* w : edited) {
+        auto it = index.find(w);
+        if (it == index.end()) continue;
+        size_t i = it->second;
+        if (has_comb(i) != (w->comb_expr != nullptr) || has_next(i) != (w->next_expr != nullptr)) return false;
+        if (w->clock && w->clock->period > 1 && !clocks.count(w->clock)) return false;
+        if (w->next_expr) relower_next[i] = 1;
+        if (!w->comb_expr) continue;
+        // A folded or pokeable driver has no op of its own for readers to be traced from.
+        if (nl.pokeable[i] || lw.is_pokeable(w) || writer[nl.wire_slot[i]] < 0) return false;
+        tainted[nl.wire_slot[i]] = 1;
+    }
+    // Everything reading an edited wire, found through the ops: a slot shared
+    // with an edited wire only makes its other readers lowered again too.
+    for (size_t i = 0; i < first; ++i) {
+        const FlatOp& op = nl.ops[i];
+        if (tainted[op.a] || tainted[op.b] || tainted[op.c]) tainted[op.dst] = 1;
+    }
+    std::vector<const Wire*> affected;
+    std::unordered_set<const Wire*> expand;
+    for (size_t i = 0; i < nl.wires.size(); ++i) {
+        if (has_comb(i) && tainted[nl.wire_slot[i]]) {
+            affected.push_back(nl.wires[i]);
+            expand.insert(nl.wires[i]);
+        }
+        if (!has_next(i)) continue;
+        const Commit& c = nl.commits[commit_of[nl.state_slot[i]]];
+        if (tainted[c.src] || (c.gate >= 0 && tainted[c.gate])) relower_next[i] = 1;
+    }
+    std::vector<char> relower_memory(nl.memories.size(), 0);
+    for (size_t m = 0; m < nl.memories.size(); ++m) {
+        size_t ports = 0;
+        for (const MemWrite& w : nl.mem_writes) {
+            if (w.base != nl.memories[m].base) continue;
+            ++ports;
+            if (tainted[w.addr] || tainted[w.data] || tainted[w.enable]) relower_memory[m] = 1;
+        }
+        if (ports != nl.memories[m].memory->write_ports.size()) return false;
+    }
+
+    CombSearch search(&expand);
+    for (const Wire* w : affected) search.add(w, nullptr);
+    for (size_t i = 0; i < nl.wires.size(); ++i) {
+        if (!relower_next[i]) continue;
+        search.add(nullptr, nl.wires[i]->next_expr);
+        if (nl.wires[i]->enable_expr) search.add(nullptr, nl.wires[i]->enable_expr);
+    }
+    for (size_t m = 0; m < nl.memories.size(); ++m) {
+        if (!relower_memory[m]) continue;
+        for (const Memory::WritePort& p : nl.memories[m].memory->write_ports) {
+            for (const ExprNode* e : {p.addr, p.data, p.enable}) search.add(nullptr, e);
+        }
+    }
+    for (size_t p = 0; p < options.probes.size(); ++p) {
+        if (tainted[nl.probe_slots[p]]) search.add(nullptr, options.probes[p].node);
+    }
+    // Wires or memories new to the circuit would need slots of their own.
+    for (const ScheduleItem& it : search.order) {
+        if (it.wire && !index.count(it.wire)) return false;
+    }
+    std::unordered_set<const Memory*> memories;
+    for (const MemoryLayout& m : nl.memories) memories.insert(m.memory);
+    for (const Memory* m : search.memories) {
+        if (!memories.count(m)) return false;
+    }
+
+    // The new logic reads the existing slots of everything not lowered again.
+    lw.slot_level.assign(slots, 0);
+    lw.slot_const.assign(slots, 0);
+    lw.slot_op = writer;
+    for (size_t i = 0; i < first; ++i) {
+        const FlatOp& op = nl.ops[i];
+        lw.slot_level[op.dst] = 1 + std::max(lw.slot_level[op.a], std::max(lw.slot_level[op.b], lw.slot_level[op.c]));
+    }
+    std::vector<char> state(slots, 0);
+    for (size_t i = 0; i < nl.wires.size(); ++i) {
+        if (nl.pokeable[i]) state[nl.wire_slot[i]] = 1;
+        if (nl.state_slot[i] >= 0) state[nl.state_slot[i]] = 1;
+        if (!expand.count(nl.wires[i])) lw.wire_value.emplace(nl.wires[i], nl.wire_slot[i]);
+    }
+    for (const MemoryLayout& m : nl.memories) {
+        for (int k = 0; k < m.memory->depth; ++k) state[m.base + k] = 1;
+        lw.memory_slot.emplace(m.memory, m.base);
+    }
+    for (const ClockLayout& c : nl.clocks) {
+        state[c.counter] = 1;
+        lw.clock_tick.emplace(c.clock, c.tick);
+    }
+    // Leaves that are not state are constants.
+    for (size_t s = 0; s < slots; ++s) {
+        if (writer[s] >= 0 || state[s] || nl.slot_width[s] > 64) continue;
+        lw.slot_const[s] = 1;
+        lw.const_slot.emplace(nl.init[s], static_cast<int>(s));
+    }
+
+    for (const ScheduleItem& it : search.order) {
+        if (it.wire) lw.lower_wire(it.wire);
+        else lw.lower_node(it.node);
+    }
+    for (const Wire* w : affected) nl.wire_slot[index[w]] = lw.lower_wire(w);
+    for (size_t i = 0; i < nl.wires.size(); ++i) {
+        if (!relower_next[i]) continue;
+        const Wire* w = nl.wires[i];
+        const ExprNode* next = w->next_expr;
+        int gate = lw.gate_of(w, next);
+        int src = lw.mask_to(lw.lower_node(next), w->width);
+        for (int k = 0; k < WideValue::words_for(w->width); ++k) {
+            Commit& c = nl.commits[commit_of[nl.state_slot[i] + k]];
+            c.src = src + k;
+            c.gate = gate;
+        }
+    }
+    for (size_t m = 0; m < nl.memories.size(); ++m) {
+        if (!relower_memory[m]) continue;
+        const Memory* mem = nl.memories[m].memory;
+        size_t port = 0;
+        for (MemWrite& w : nl.mem_writes) {
+            if (w.base != nl.memories[m].base) continue;
+            const Memory::WritePort& p = mem->write_ports[port++];
+            w.addr = lw.mask_to(lw.lower_node(p.addr), 64);
+            w.data = lw.mask_to(lw.lower_node(p.data), mem->width);
+            w.enable = lw.mask_to(lw.lower_node(p.enable), 64);
+        }
+    }
+    for (size_t p = 0; p < options.probes.size(); ++p) {
+        if (!tainted[nl.probe_slots[p]]) continue;
+        int slot = lw.lower_node(options.probes[p].node);
+        if (nl.slot_width[slot] > 64) slot = lw.emit(lw.binary(OpType::Ne, slot, lw.constant(0)));
+        nl.probe_slots[p] = slot;
+    }
+
+    if (options.optimize) remove_dead_ops(nl, first);
+    levelize(nl, lw.slot_level, first);
+    return true;
+}
+
+// Rough relative cost of evaluating one op in the interpreter.
+static int op_cost(const FlatOp& op) {
+    if (op.width) return 4 * WideValue::words_for(op.width);
+    switch (op.op) {
+        case OpType::Div: case OpType::Mod: return 8;
+        case OpType::Mul: return 3;
+        case OpType::MemRead: return 2;
+        default: return 1;
+    }
+}
+
+std::vector<LazyStep> lazy_schedule(const Netlist& nl, const std::vector<int>& demanded, int min_cost) {
+    // Post-dominator tree over the ops: an op's parent is the nearest node
+    // every path from it to a demanded slot passes through. Reading a branch
+    // operand goes through an extra node per guarded branch, so a branch's
+    // subtree is exactly the logic only that branch needs. Gated commits
+    // read through one branch per gate below a pseudo-op `n` standing for
+    // the clock edge. Readers come after their operands in levelized order,
+    // so one backward pass builds the tree.
+    const int n = static_cast<int>(nl.ops.size());
+    const int edge = n, kRoot = -1, kUnset = -2;
+    struct Branch {
+        int guard;
+        int cond;
+        bool when;
+        int cost;
+        bool gate;
+    };
+    std::vector<Branch> branches;
+    std::vector<int> first_branch(n + 1, -1), branch_count(n + 1, 0);
+    // Node ids: ops are 0..n-1, the edge is n, branch b is n + 1 + b.
+    std::vector<int> parent(n + 1, kUnset), depth(n + 1, 0), cost(n + 1, 0), branch_depth;
+    std::vector<int> writer(nl.init.size(), -1);
+    for (int i = 0; i < n; ++i) writer[nl.ops[i].dst] = i;
+
+    auto node_parent = [&](int v) { return v > n ? branches[v - n - 1].guard : parent[v]; };
+    auto node_depth = [&](int v) { return v == kRoot ? 0 : v > n ? branch_depth[v - n - 1] : depth[v]; };
+    auto meet = [&](int u, int v) {
+        while (u != v) {
+            if (node_depth(u) >= node_depth(v)) u = node_parent(u);
+            else v = node_parent(v);
+        }
+        return u;
+    };
+    auto reach = [&](int slot, int node) {
+        int w = writer[slot];
+        if (w < 0) return;
+        parent[w] = parent[w] == kUnset ? node : meet(parent[w], node);
+    };
+    auto add_branch = [&](int guard, int cond, bool when, bool gate) {
+        if (first_branch[guard] < 0) first_branch[guard] = static_cast<int>(branches.size());
+        ++branch_count[guard];
+        branches.push_back(Branch{guard, cond, when, 0, gate});
+        branch_depth.push_back(depth[guard] + 1);
+        return n + static_cast<int>(branches.size());
+    };
+
+    for (int s : demanded) reach(s, kRoot);
+    parent[edge] = kRoot;
+    depth[edge] = 1;
+    std::unordered_map<int, int> gate_branch;
+    for (const Commit& c : nl.commits) {
+        if (c.gate < 0) { reach(c.src, kRoot); continue; }
+        reach(c.gate, kRoot);
+        auto it = gate_branch.find(c.gate);
+        if (it == gate_branch.end()) it = gate_branch.emplace(c.gate, add_branch(edge, c.gate, true, true)).first;
+        reach(c.src, it->second);
+    }
+
+    for (int i = n; i-- > 0;) {
+        if (parent[i] == kUnset) continue; // nothing demanded reads it
+        const FlatOp& op = nl.ops[i];
+        depth[i] = node_depth(parent[i]) + 1;
+        cost[i] = op_cost(op);
+        bool scalar = op.width == 0;
+        if (scalar && op.op == OpType::Select) {
+            int take_b = op.b != op.a && op.b != op.c ? add_branch(i, op.a, true, false) : i;
+            int take_c = op.c != op.a && op.c != op.b ? add_branch(i, op.a, false, false) : i;
+            reach(op.a, i);
+            reach(op.b, take_b);
+            reach(op.c, take_c);
+        } else if (scalar && (op.op == OpType::LogAnd || op.op == OpType::LogOr) && op.b != op.a) {
+            int take_b = add_branch(i, op.a, op.op == OpType::LogAnd, false);
+            reach(op.a, i);
+            reach(op.b, take_b);
+        } else {
+            reach(op.a, i);
+            if (op.b != op.a) reach(op.b, i);
+            if (op.c != op.a && op.c != op.b) reach(op.c, i);
+        }
+    }
+
+    // Subtree costs, children first. A gate is always worth its branch: the
+    // commit tests it anyway.
+    for (int i = 0; i <= n; ++i) {
+        if (parent[i] == kUnset) continue;
+        for (int b = first_branch[i]; b >= 0 && b < first_branch[i] + branch_count[i]; ++b) cost[i] += branches[b].cost;
+        int p = parent[i];
+        if (p > n) branches[p - n - 1].cost += cost[i];
+        else if (p != kRoot) cost[p] += cost[i];
+    }
+    auto guarded = [&](const Branch& b) { return b.cost > 0 && (b.gate || b.cost >= min_cost); };
+
+    // Each op joins the innermost guarded branch above it, or the top level.
+    // Body 0 is the top level and body b + 1 is branch b.
+    std::vector<int> body_of(n + 1, 0);
+    std::vector<std::vector<int>> bodies(branches.size() + 1);
+    for (int i = n; i-- > 0;) {
+        int p = parent[i];
+        if (p == kUnset) continue;
+        if (p > n) {
+            const Branch& b = branches[p - n - 1];
+            body_of[i] = guarded(b) ? p - n : body_of[b.guard];
+        } else if (p != kRoot) {
+            body_of[i] = body_of[p];
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        if (parent[i] != kUnset) bodies[body_of[i]].push_back(i);
+    }
+    // The gated next-state logic runs after everything else.
+    bodies[0].push_back(edge);
+
+    // Emit each guard's branch bodies right before it, depth first.
+    std::vector<LazyStep> steps;
+    struct Frame {
+        int body;
+        size_t pos;
+        int branch; // next branch of the current op to emit
+        size_t skip_step;
+    };
+    std::vector<Frame> stack {Frame{0, 0, 0, 0}};
+    while (!stack.empty()) {
+        Frame& f = stack.back();
+        const std::vector<int>& ops = bodies[f.body];
+        if (f.pos == ops.size()) {
+            stack.pop_back();
+            if (stack.empty()) break;
+            Frame& up = stack.back();
+            steps[up.skip_step].skip = static_cast<int>(steps.size() - up.skip_step - 1);
+            ++up.branch;
+            continue;
+        }
+        int i = ops[f.pos];
+        for (; f.branch < branch_count[i]; ++f.branch) {
+            if (guarded(branches[first_branch[i] + f.branch])) break;
+        }
+        if (f.branch < branch_count[i]) {
+            int b = first_branch[i] + f.branch;
+            f.skip_step = steps.size();
+            LazyStep skip;
+            skip.cond = branches[b].cond;
+            skip.when = branches[b].when;
+            steps.push_back(skip);
+            stack.push_back(Frame{b + 1, 0, 0, 0});
+            continue;
+        }
+        if (i != edge) {
+            LazyStep run;
+            run.op = i;
+            steps.push_back(run);
+        }
+        ++f.pos;
+        f.branch = 0;
+    }
+    return steps;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "operations.h"
+
+struct Wire;
+struct Memory;
+struct Clock;
+
+// One instruction of the flattened circuit: v[dst] = op(v[a], v[b], v[c]).
+// Unary ops only read `a`; only Select reads `c`. MemRead reads the cell at
+// index v[a] of the memory whose cells start at slot `b`, with `c` a constant
+// slot holding the depth (see eval_mem_read). Ops touching a signal
+// wider than 64 bits set `width` to their result width and are evaluated by
+// eval_wide_op (wide.h); scalar ops leave it 0.
+struct FlatOp {
+    OpType op {OpType::Constant};
+    unsigned short width {0};
+    int dst {0};
+    int a {0};
+    int b {0};
+    int c {0};
+};
+
+// Clock-edge transfer: committed state slot `dst` takes the next-state value
+// held in `src`, unless `gate` is a slot holding 0 this cycle (an inactive
+// clock domain or a disabled register). Wide state has one commit per word.
+struct Commit {
+    int src {0};
+    int dst {0};
+    int gate {-1};
+};
+
+// Value `dst` holds after the clock edge.
+inline long long commit_value(const Commit& c, const long long* v) {
+    return c.gate < 0 || v[c.gate] != 0 ? v[c.src] : v[c.dst];
+}
+
+// A derived clock: `counter` is a register stepping through 0..period-1 and
+// `tick` is 1 on the cycles the domain ticks.
+struct ClockLayout {
+    const Clock* clock {nullptr};
+    int counter {0};
+    int tick {0};
+};
+
+// Cells [base, base + memory->depth) hold a memory's committed entries.
+struct MemoryLayout {
+    const Memory* memory {nullptr};
+    int base {0};
+};
+
+// Clock-edge memory write: when v[enable] != 0 and v[addr] < depth, cell
+// base + v[addr] takes v[data]. Writes apply in order, after the commits.
+struct MemWrite {
+    int addr {0};
+    int data {0};
+    int enable {0};
+    int base {0};
+    int depth {0};
+};
+
+// A circuit lowered to dense slot storage. Slots hold constants, committed
+// register state and op results; every op writes its own slot, and ops are
+// sorted by level so a single linear pass evaluates one cycle. A signal wider
+// than 64 bits occupies consecutive slots, one per word, starting at its slot.
+struct Netlist {
+    std::vector<const Wire*> wires;   // dependency closure of the targets, in discovery order
+    std::vector<size_t> targets;      // indices into `wires` of the requested targets
+    std::vector<int> wire_slot;       // slot holding each wire's value within a cycle
+    std::vector<int> state_slot;      // slot holding each wire's committed value, -1 if it has none
+    std::vector<char> pokeable;       // wire's slot is an input or register that may be overwritten
+    std::vector<FlatOp> ops;          // comb and next-state logic, levelized
+    std::vector<size_t> level_begin;  // level i is ops[level_begin[i], level_begin[i + 1])
+    std::vector<Commit> commits;      // applied together at the clock edge
+    std::vector<MemoryLayout> memories;
+    std::vector<ClockLayout> clocks;
+    std::vector<MemWrite> mem_writes;
+    std::vector<long long> init;      // initial slot contents: constants and committed values
+    std::vector<unsigned short> slot_width; // inferred bits per slot; other than 64 the value is unsigned and fits
+    std::vector<int> probe_slots;     // scalar slot holding each of CompileOptions::probes
+};
+
+struct CompileOptions {
+    // Fold constant subtrees, propagate constant-driven wires and apply
+    // identity/annihilator rules (x * 1, x & 0, If(1, a, b), ...).
+    bool optimize {true};
+    // Constant-driven wires that must stay pokeable instead of being folded.
+    std::vector<const Wire*> inputs;
+    // Extra expressions lowered into the same schedule as the targets, such
+    // as assertion conditions; Netlist::probe_slots says where each lands.
+    std::vector<Expr> probes;
+};
+
+// Lower the dependency closure of `targets` into a levelized netlist. Initial
+// state is taken from the wires' current committed values.
+Netlist compile_netlist(const std::vector<const Wire*>& targets, const CompileOptions& options = {});
+
+// Updates `nl`, compiled by compile_netlist() with the same `options`, for
+// new drivers of the `edited` wires. Only the logic reading them is lowered
+// again, into ops appended after the existing ones in levels of their own;
+// the wires, commits, memory writes and probes it feeds are pointed at the
+// new slots. Existing ops and slots are left in place, so state carries over
+// and code generated for those ops stays valid; the replaced ones still run
+// until the next full compile. Returns false, leaving `nl` partly updated,
+// when the edit changes more than logic: wires or memories new to the
+// circuit, a wire gaining or losing a driver, a register moved to a new
+// clock, an edited constant that was folded into its readers or is an input.
+// Throws std::invalid_argument for a combinational loop.
+bool patch_netlist(Netlist& nl, const std::vector<const Wire*>& edited, const CompileOptions& options = {});
+
+// One step of a demand-driven schedule: evaluate ops[op], or, when op is -1,
+// skip the next `skip` steps unless truthy(v[cond]) == when.
+struct LazyStep {
+    int op {-1};
+    int cond {0};
+    int skip {0};
+    bool when {true};
+};
+
+// A schedule evaluating only what the `demanded` slots need this cycle, plus
+// the commits: a gated commit's next-state logic runs only when its gate is
+// set, so registers of an idle domain or behind a low enable cost nothing. Ops
+// feeding nothing but one branch of a Select, or the right operand of a
+// LogAnd/LogOr, are grouped behind a skip over them when that branch is not
+// taken; a group is only guarded if its estimated cost, in units of a simple
+// op, is at least `min_cost`, since a cheap cone runs faster straight-line
+// than behind a branch. Ops no demanded slot depends on are left out, so
+// other slots may hold stale values after a lazy evaluation.
+std::vector<LazyStep> lazy_schedule(const Netlist& nl, const std::vector<int>& demanded, int min_cost);
+
+// True when any op or slot needs the multi-word path.
+inline bool has_wide_signals(const Netlist& nl) {
+    for (unsigned short w : nl.slot_width) if (w > 64) return true;
+    return false;
+}
+
+inline long long truthy(long long v) { return v != 0 ? 1 : 0; }
+
+// Shifts by an amount outside 0..63 move every bit out: << gives 0 and >>,
+// which is arithmetic, gives 0 or -1 by the sign. << wraps like an unsigned shift.
+inline long long shift_left(long long x, long long n) {
+    return static_cast<unsigned long long>(n) < 64 ? static_cast<long long>(static_cast<unsigned long long>(x) << n) : 0;
+}
+inline long long shift_right(long long x, long long n) {
+    return static_cast<unsigned long long>(n) < 64 ? x >> n : (x < 0 ? -1 : 0);
+}
+
+// Semantics of a single non-leaf op on already evaluated operands.
+inline long long eval_op(OpType op, long long x, long long y, long long z) {
+    switch (op) {
+        case OpType::Constant:
+        case OpType::WireRef: return x;
+        case OpType::Add: return x + y;
+        case OpType::Sub: return x - y;
+        case OpType::Mul: return x * y;
+        case OpType::Div: return y == 0 ? 0 : x / y;
+        case OpType::Mod: return y == 0 ? 0 : x % y;
+        case OpType::BitAnd: return x & y;
+        case OpType::BitOr: return x | y;
+        case OpType::BitXor: return x ^ y;
+        case OpType::BitNot: return ~x;
+        case OpType::Neg: return -x;
+        case OpType::Shl: return shift_left(x, y);
+        case OpType::Shr: return shift_right(x, y);
+        case OpType::LogAnd: return truthy(x) && truthy(y);
+        case OpType::LogOr: return truthy(x) || truthy(y);
+        case OpType::LogNot: return !truthy(x);
+        case OpType::Eq: return x == y;
+        case OpType::Ne: return x != y;
+        case OpType::Lt: return x < y;
+        case OpType::Le: return x <= y;
+        case OpType::Gt: return x > y;
+        case OpType::Ge: return x >= y;
+        case OpType::Select: return truthy(x) ? y : z;
+        case OpType::MemRead: return 0; // reads slot storage, see eval_mem_read
+    }
+    return 0;
+}
+
+inline long long eval_mem_read(const FlatOp& op, const long long* v) {
+    unsigned long long i = static_cast<unsigned long long>(v[op.a]);
+    return i < static_cast<unsigned long long>(v[op.c]) ? v[op.b + i] : 0;
+}
+
+// Cell written by `w` this cycle, or -1 if the write is disabled or out of range.
+inline int mem_write_cell(const MemWrite& w, const long long* v) {
+    unsigned long long i = static_cast<unsigned long long>(v[w.addr]);
+    return v[w.enable] != 0 && i < static_cast<unsigned long long>(w.depth) ? w.base + static_cast<int>(i) : -1;
+}
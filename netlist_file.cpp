@@ -0,0 +1,261 @@
+#include "netlist_file.h"
+#include "wide.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The reader takes the arrays in native byte order.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "netlist files are little-endian");
+
+static const char kNetlistMagic[4] = {'C', 'N', 'L', '1'};
+
+// Section sizes in header order.
+enum NetlistSection { kSlots, kOps, kLevels, kCommits, kMemWrites, kWires, kTargets, kMemories, kClocks, kProbes, kSections };
+
+static void put64(std::string& out, uint64_t v) {
+    for (int k = 0; k < 8; ++k) out.push_back(static_cast<char>(v >> (8 * k)));
+}
+
+static void put32(std::string& out, int32_t v) {
+    uint32_t u = static_cast<uint32_t>(v);
+    for (int k = 0; k < 4; ++k) out.push_back(static_cast<char>(u >> (8 * k)));
+}
+
+static void pad8(std::string& out) {
+    out.resize((out.size() + 7) & ~size_t(7), '\0');
+}
+
+static void put_name(std::string& out, const std::string& name) {
+    put64(out, name.size());
+    out += name;
+    pad8(out);
+}
+
+void save_netlist(const Netlist& nl, const std::string& path) {
+    std::string out(kNetlistMagic, sizeof kNetlistMagic);
+    pad8(out);
+    size_t counts[kSections] = {nl.init.size(), nl.ops.size(), nl.level_begin.size(), nl.commits.size(), nl.mem_writes.size(),
+                                nl.wires.size(), nl.targets.size(), nl.memories.size(), nl.clocks.size(), nl.probe_slots.size()};
+    for (size_t n : counts) put64(out, n);
+    for (long long v : nl.init) put64(out, static_cast<uint64_t>(v));
+    for (unsigned short w : nl.slot_width) put32(out, w);
+    pad8(out);
+    for (const FlatOp& op : nl.ops) {
+        for (int32_t v : {static_cast<int32_t>(op.op), static_cast<int32_t>(op.width), op.dst, op.a, op.b, op.c}) put32(out, v);
+    }
+    pad8(out);
+    for (size_t l : nl.level_begin) put64(out, l);
+    for (const Commit& c : nl.commits) {
+        for (int32_t v : {c.src, c.dst, c.gate}) put32(out, v);
+    }
+    pad8(out);
+    for (const MemWrite& w : nl.mem_writes) {
+        for (int32_t v : {w.addr, w.data, w.enable, w.base, w.depth}) put32(out, v);
+    }
+    pad8(out);
+    for (size_t i = 0; i < nl.wires.size(); ++i) {
+        for (int32_t v : {nl.wire_slot[i], nl.state_slot[i], static_cast<int32_t>(nl.pokeable[i]), nl.wires[i]->width}) put32(out, v);
+    }
+    pad8(out);
+    for (size_t t : nl.targets) put64(out, t);
+    for (const MemoryLayout& m : nl.memories) {
+        for (int32_t v : {m.base, m.memory->depth, m.memory->width}) put32(out, v);
+    }
+    pad8(out);
+    for (const ClockLayout& c : nl.clocks) {
+        for (int32_t v : {c.counter, c.tick, c.clock->period, c.clock->phase}) put32(out, v);
+    }
+    pad8(out);
+    for (int s : nl.probe_slots) put32(out, s);
+    pad8(out);
+    for (const Wire* w : nl.wires) put_name(out, w->name);
+    for (const MemoryLayout& m : nl.memories) put_name(out, m.memory->name);
+    for (const ClockLayout& c : nl.clocks) put_name(out, c.clock->name);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open '" + path + "' for writing");
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (!file) throw std::runtime_error("netlist write to '" + path + "' failed");
+}
+
+namespace {
+
+// Bounds-checked cursor over the mapped file.
+struct Reader {
+    const unsigned char* p;
+    size_t size;
+    size_t pos;
+    const std::string& path;
+
+    void need(size_t bytes) const {
+        if (bytes > size - pos) throw std::runtime_error("netlist: '" + path + "' is truncated");
+    }
+    template <class T>
+    const T* array(size_t n) {
+        need(n * sizeof(T));
+        const T* a = reinterpret_cast<const T*>(p + pos);
+        pos = (pos + n * sizeof(T) + 7) & ~size_t(7);
+        return a;
+    }
+    std::string name() {
+        uint64_t len = *array<uint64_t>(1);
+        need(len);
+        std::string s(reinterpret_cast<const char*>(p + pos), len);
+        pos = (pos + len + 7) & ~size_t(7);
+        return s;
+    }
+};
+
+// The file is only mapped while it is parsed; the arrays are copied out in bulk.
+struct MappedFile {
+    void* map {nullptr};
+    size_t size {0};
+    ~MappedFile() {
+        if (map) ::munmap(map, size);
+    }
+};
+
+} // namespace
+
+NetlistFile::NetlistFile(const std::string& path): loaded_(std::make_shared<Loaded>()) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open '" + path + "'");
+    struct stat st;
+    MappedFile file;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(8 + 8 * kSections)) {
+        ::close(fd);
+        throw std::runtime_error("netlist: '" + path + "' is not a netlist file");
+    }
+    file.size = static_cast<size_t>(st.st_size);
+    file.map = ::mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (file.map == MAP_FAILED) {
+        file.map = nullptr;
+        throw std::runtime_error("cannot map '" + path + "'");
+    }
+    Reader in{static_cast<const unsigned char*>(file.map), file.size, 8, path};
+    if (std::memcmp(in.p, kNetlistMagic, sizeof kNetlistMagic) != 0) throw std::runtime_error("netlist: '" + path + "' is not a netlist file");
+    const uint64_t* counts = in.array<uint64_t>(kSections);
+    for (int s = 0; s < kSections; ++s) {
+        if (counts[s] > file.size) throw std::runtime_error("netlist: '" + path + "' is truncated");
+    }
+    size_t slots = counts[kSlots];
+    auto slot_ok = [slots](int32_t s) { return s >= 0 && static_cast<size_t>(s) < slots; };
+    auto malformed = [&path]() { return std::runtime_error("netlist: '" + path + "' is malformed"); };
+
+    Netlist& nl = loaded_->nl;
+    const int64_t* init = in.array<int64_t>(slots);
+    nl.init.assign(init, init + slots);
+    const int32_t* widths = in.array<int32_t>(slots);
+    for (size_t i = 0; i < slots; ++i) {
+        // A wide slot's words follow it.
+        if (widths[i] < 1 || widths[i] > kMaxWireWidth || i + WideValue::words_for(widths[i]) > slots) throw malformed();
+    }
+    nl.slot_width.assign(widths, widths + slots);
+    const int32_t* ops = in.array<int32_t>(6 * counts[kOps]);
+    nl.ops.resize(counts[kOps]);
+    for (size_t i = 0; i < nl.ops.size(); ++i) {
+        const int32_t* r = ops + 6 * i;
+        if (r[0] < 0 || r[0] > static_cast<int32_t>(OpType::MemRead) || !slot_ok(r[2]) || !slot_ok(r[3]) || !slot_ok(r[4]) || !slot_ok(r[5])) throw malformed();
+        if (r[1] < 0 || r[1] > kMaxWireWidth || (r[1] > 64 && static_cast<size_t>(r[2]) + WideValue::words_for(r[1]) > slots)) throw malformed();
+        FlatOp& op = nl.ops[i];
+        op.op = static_cast<OpType>(r[0]);
+        op.width = static_cast<unsigned short>(r[1]);
+        op.dst = r[2];
+        op.a = r[3];
+        op.b = r[4];
+        op.c = r[5];
+    }
+    const uint64_t* levels = in.array<uint64_t>(counts[kLevels]);
+    for (size_t l = 0; l < counts[kLevels]; ++l) {
+        if (levels[l] > counts[kOps] || (l > 0 && levels[l] < levels[l - 1])) throw malformed();
+    }
+    // The levels must cover every op, or some would never run.
+    if (counts[kLevels] == 0 || levels[0] != 0 || levels[counts[kLevels] - 1] != counts[kOps]) throw malformed();
+    nl.level_begin.assign(levels, levels + counts[kLevels]);
+    const int32_t* commits = in.array<int32_t>(3 * counts[kCommits]);
+    for (size_t i = 0; i < counts[kCommits]; ++i) {
+        const int32_t* r = commits + 3 * i;
+        if (!slot_ok(r[0]) || !slot_ok(r[1]) || (r[2] != -1 && !slot_ok(r[2]))) throw malformed();
+        nl.commits.push_back(Commit{r[0], r[1], r[2]});
+    }
+    const int32_t* writes = in.array<int32_t>(5 * counts[kMemWrites]);
+    for (size_t i = 0; i < counts[kMemWrites]; ++i) {
+        const int32_t* r = writes + 5 * i;
+        if (!slot_ok(r[0]) || !slot_ok(r[1]) || !slot_ok(r[2]) || !slot_ok(r[3]) || r[4] < 1 || static_cast<size_t>(r[3]) + r[4] > slots) throw malformed();
+        nl.mem_writes.push_back(MemWrite{r[0], r[1], r[2], r[3], r[4]});
+    }
+    const int32_t* wires = in.array<int32_t>(4 * counts[kWires]);
+    const uint64_t* targets = in.array<uint64_t>(counts[kTargets]);
+    const int32_t* memories = in.array<int32_t>(3 * counts[kMemories]);
+    const int32_t* clocks = in.array<int32_t>(4 * counts[kClocks]);
+    const int32_t* probes = in.array<int32_t>(counts[kProbes]);
+
+    for (size_t i = 0; i < counts[kWires]; ++i) {
+        const int32_t* r = wires + 4 * i;
+        if (!slot_ok(r[0]) || (r[1] != -1 && !slot_ok(r[1])) || r[3] < 1 || r[3] > kMaxWireWidth) throw malformed();
+        loaded_->wires.emplace_back(in.name(), nl.init[r[1] >= 0 ? r[1] : r[0]], r[3]);
+        nl.wires.push_back(&loaded_->wires.back());
+        nl.wire_slot.push_back(r[0]);
+        nl.state_slot.push_back(r[1]);
+        nl.pokeable.push_back(static_cast<char>(r[2] != 0));
+    }
+    for (size_t i = 0; i < counts[kTargets]; ++i) {
+        if (targets[i] >= counts[kWires]) throw malformed();
+        nl.targets.push_back(static_cast<size_t>(targets[i]));
+    }
+    for (size_t i = 0; i < counts[kMemories]; ++i) {
+        const int32_t* r = memories + 3 * i;
+        if (!slot_ok(r[0]) || r[1] < 1 || static_cast<size_t>(r[0]) + r[1] > slots || r[2] < 1 || r[2] > 64) throw malformed();
+        loaded_->memories.emplace_back(in.name(), r[1], r[2], std::vector<long long>(nl.init.begin() + r[0], nl.init.begin() + r[0] + r[1]));
+        nl.memories.push_back(MemoryLayout{&loaded_->memories.back(), r[0]});
+    }
+    for (size_t i = 0; i < counts[kClocks]; ++i) {
+        const int32_t* r = clocks + 4 * i;
+        if (!slot_ok(r[0]) || !slot_ok(r[1]) || r[2] < 1 || r[3] < 0 || r[3] >= r[2]) throw malformed();
+        loaded_->clocks.emplace_back(in.name(), r[2], r[3]);
+        nl.clocks.push_back(ClockLayout{&loaded_->clocks.back(), r[0], r[1]});
+    }
+    // A memory read indexes from its `b` slot up to the depth in its `c` slot,
+    // so that must be a saved memory and a constant holding its depth.
+    std::vector<char> written(slots, 0);
+    for (const FlatOp& op : nl.ops) written[op.dst] = 1;
+    for (const Commit& c : nl.commits) written[c.dst] = 1;
+    for (size_t i = 0; i < nl.wires.size(); ++i) {
+        if (nl.pokeable[i]) written[nl.wire_slot[i]] = 1;
+    }
+    for (const FlatOp& op : nl.ops) {
+        if (op.op != OpType::MemRead) continue;
+        auto m = std::find_if(nl.memories.begin(), nl.memories.end(), [&op](const MemoryLayout& l) { return l.base == op.b; });
+        if (m == nl.memories.end() || written[op.c] || nl.init[op.c] < 0 || nl.init[op.c] > m->memory->depth) throw malformed();
+    }
+    for (size_t i = 0; i < counts[kProbes]; ++i) {
+        if (!slot_ok(probes[i])) throw malformed();
+        nl.probe_slots.push_back(probes[i]);
+    }
+    for (const Wire& w : loaded_->wires) wires_.emplace(w.name, &w);
+    for (const Memory& m : loaded_->memories) memories_.emplace(m.name, &m);
+}
+
+std::shared_ptr<const Netlist> NetlistFile::netlist() const {
+    // Aliasing: the netlist keeps the stand-in wires it points to alive.
+    return std::shared_ptr<const Netlist>(loaded_, &loaded_->nl);
+}
+
+const Wire* NetlistFile::wire(const std::string& name) const {
+    auto it = wires_.find(name);
+    return it == wires_.end() ? nullptr : it->second;
+}
+
+const Memory* NetlistFile::memory(const std::string& name) const {
+    auto it = memories_.find(name);
+    return it == memories_.end() ? nullptr : it->second;
+}
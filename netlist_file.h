@@ -0,0 +1,58 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "netlist.h"
+#include "wire.h"
+
+// Binary netlist file (".cnl"): the magic "CNL1", the section sizes as
+// 64-bit counts, then fixed-width little-endian arrays, each padded to a
+// multiple of 8 bytes: the initial slot values (64-bit), slot widths, ops
+// (6 x 32-bit), level starts (64-bit), commits (3 x 32-bit), memory writes
+// (5 x 32-bit), wires (4 x 32-bit), targets (64-bit), memories (3 x 32-bit),
+// clocks (4 x 32-bit) and probe slots (32-bit). The names of the wires, memories and clocks
+// follow, each as a 64-bit length and its bytes padded to 8. The file is
+// mapped while it is parsed and the arrays are copied out of the mapping in
+// native byte order, so the reader only builds for little-endian hosts.
+//
+// Throws std::runtime_error if the file cannot be written.
+void save_netlist(const Netlist& nl, const std::string& path);
+
+// A netlist loaded from a file written by save_netlist(), for starting a
+// Simulator without elaborating the circuit:
+//
+//     NetlistFile file("soc.cnl");
+//     Simulator sim(file.netlist(), options);
+//     sim.poke(*file.wire("reset"), 0);
+//
+// The wires, memories and clocks of the loaded netlist are stand-ins with
+// the saved names, widths and initial values but no drivers; they identify
+// signals to poke(), peek() and the sinks. netlist() shares ownership of
+// them, so simulators stay valid after the NetlistFile is gone.
+class NetlistFile {
+public:
+    // Throws std::runtime_error if the file cannot be mapped or is malformed.
+    explicit NetlistFile(const std::string& path);
+
+    NetlistFile(const NetlistFile&) = delete;
+    NetlistFile& operator=(const NetlistFile&) = delete;
+
+    std::shared_ptr<const Netlist> netlist() const;
+    // The saved wire or memory called `name`, or nullptr.
+    const Wire* wire(const std::string& name) const;
+    const Memory* memory(const std::string& name) const;
+
+private:
+    struct Loaded {
+        std::deque<Wire> wires;
+        std::deque<Memory> memories;
+        std::deque<Clock> clocks;
+        Netlist nl;
+    };
+    std::shared_ptr<Loaded> loaded_;
+    std::unordered_map<std::string, const Wire*> wires_;
+    std::unordered_map<std::string, const Memory*> memories_;
+};
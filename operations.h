@@ -1,6 +1,11 @@
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 struct Wire; // forward declaration
 
@@ -29,42 +34,150 @@ enum class OpType {
     Le,
     Gt,
     Ge,
-    Select // condition ? thenExpr : elseExpr
+    Select, // condition ? thenExpr : elseExpr
+    MemRead // memory[a], see Memory in wire.h
 };
 
+struct Memory;
+
 struct ExprNode {
     OpType op {OpType::Constant};
     long long constant_value {0};
     const Wire* wire {nullptr};
-    std::shared_ptr<ExprNode> a;
-    std::shared_ptr<ExprNode> b;
-    std::shared_ptr<ExprNode> c;
+    const Memory* memory {nullptr}; // MemRead only
+    const ExprNode* a {nullptr};
+    const ExprNode* b {nullptr};
+    const ExprNode* c {nullptr};
+};
+
+inline bool is_commutative(OpType op) {
+    switch (op) {
+        case OpType::Add: case OpType::Mul: case OpType::BitAnd: case OpType::BitOr: case OpType::BitXor:
+        case OpType::LogAnd: case OpType::LogOr: case OpType::Eq: case OpType::Ne: return true;
+        default: return false;
+    }
+}
+
+// Owns expression nodes in large contiguous blocks, so building a netlist
+// costs no per-node heap allocation or reference counting and related nodes
+// sit close together in memory. Nodes live exactly as long as their arena.
+// New nodes go to the arena an ArenaScope on this thread selects, else to the
+// arena of their operands' circuit (see Circuit), else to a process-wide
+// default arena. The default arena is locked, so threads may share it; its
+// nodes live until the process exits.
+//
+// The factories below go through intern(), which hash-conses nodes: building
+// the same subexpression twice yields the same node, so the compiled netlist
+// evaluates it once per cycle.
+class ExprArena {
+public:
+    ExprArena() = default;
+    ExprArena(const ExprArena&) = delete;
+    ExprArena& operator=(const ExprArena&) = delete;
+
+    // A fresh node that is never shared.
+    ExprNode* make() {
+        if (blocks_.empty() || used_ == kBlockSize) {
+            blocks_.emplace_back(new ExprNode[kBlockSize]);
+            used_ = 0;
+        }
+        return &blocks_.back()[used_++];
+    }
+
+    // The unique node with these fields. Operands of commutative ops are put
+    // in a canonical order first, so `a + b` and `b + a` share a node.
+    const ExprNode* intern(OpType op, long long constant_value, const Wire* wire,
+                           const ExprNode* a, const ExprNode* b, const ExprNode* c, const Memory* memory = nullptr) {
+        std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+        if (this == &default_arena()) lock.lock();
+        if (is_commutative(op) && std::less<const ExprNode*>()(b, a)) std::swap(a, b);
+        NodeKey key {op, constant_value, wire, memory, a, b, c};
+        auto it = interned_.find(key);
+        if (it != interned_.end()) return it->second;
+        ExprNode* n = make();
+        n->op = op; n->constant_value = constant_value; n->wire = wire; n->memory = memory; n->a = a; n->b = b; n->c = c;
+        interned_.emplace(key, n);
+        return n;
+    }
+
+    size_t size() const { return blocks_.empty() ? 0 : (blocks_.size() - 1) * kBlockSize + used_; }
+
+    static ExprArena& current() { return active() ? *active() : default_arena(); }
+    // current(), but `owner` (an operand's arena, or nullptr) before the default.
+    static ExprArena& current(ExprArena* owner) { return active() ? *active() : owner ? *owner : default_arena(); }
+
+private:
+    friend class ArenaScope;
+    static const size_t kBlockSize = 4096;
+
+    struct NodeKey {
+        OpType op;
+        long long constant_value;
+        const Wire* wire;
+        const Memory* memory;
+        const ExprNode* a;
+        const ExprNode* b;
+        const ExprNode* c;
+        bool operator==(const NodeKey& o) const {
+            return op == o.op && constant_value == o.constant_value && wire == o.wire && memory == o.memory && a == o.a && b == o.b && c == o.c;
+        }
+    };
+
+    struct NodeKeyHash {
+        size_t operator()(const NodeKey& k) const {
+            size_t h = std::hash<long long>()(k.constant_value) ^ (static_cast<size_t>(k.op) * 0x9e3779b97f4a7c15ULL);
+            auto mix = [&h](const void* p) { h = (h ^ std::hash<const void*>()(p)) * 0x100000001b3ULL; };
+            mix(k.wire); mix(k.memory); mix(k.a); mix(k.b); mix(k.c);
+            return h;
+        }
+    };
+
+    static ExprArena& default_arena() { static ExprArena a; return a; }
+    static ExprArena*& active() { static thread_local ExprArena* a = nullptr; return a; }
+
+    std::vector<std::unique_ptr<ExprNode[]>> blocks_;
+    size_t used_ {0};
+    std::unordered_map<NodeKey, const ExprNode*, NodeKeyHash> interned_;
+    std::mutex mutex_; // only taken by the default arena
+};
+
+// Routes node allocation on this thread to `arena` until the scope ends.
+class ArenaScope {
+public:
+    explicit ArenaScope(ExprArena& arena): prev_(ExprArena::active()) { ExprArena::active() = &arena; }
+    ~ArenaScope() { ExprArena::active() = prev_; }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    ExprArena* prev_;
 };
 
 struct Expr {
-    std::shared_ptr<ExprNode> node;
+    const ExprNode* node {nullptr};
+    ExprArena* arena {nullptr}; // arena of the circuit the operands came from, passed on to results
 
     Expr() = default;
-    explicit Expr(long long v) { node = std::make_shared<ExprNode>(); node->op = OpType::Constant; node->constant_value = v; }
-    explicit Expr(std::shared_ptr<ExprNode> n): node(std::move(n)) {}
+    explicit Expr(long long v, ExprArena* owner = nullptr)
+        : node(ExprArena::current(owner).intern(OpType::Constant, v, nullptr, nullptr, nullptr, nullptr)), arena(owner) {}
+    explicit Expr(const ExprNode* n, ExprArena* owner = nullptr): node(n), arena(owner) {}
 
     static Expr wireRef(const Wire* w);
 };
 
 // Helpers
 inline Expr make_unary(OpType op, const Expr& x) {
-    auto n = std::make_shared<ExprNode>();
-    n->op = op; n->a = x.node; return Expr(n);
+    return Expr(ExprArena::current(x.arena).intern(op, 0, nullptr, x.node, nullptr, nullptr), x.arena);
 }
 
 inline Expr make_binary(OpType op, const Expr& x, const Expr& y) {
-    auto n = std::make_shared<ExprNode>();
-    n->op = op; n->a = x.node; n->b = y.node; return Expr(n);
+    ExprArena* owner = x.arena ? x.arena : y.arena;
+    return Expr(ExprArena::current(owner).intern(op, 0, nullptr, x.node, y.node, nullptr), owner);
 }
 
 inline Expr make_select(const Expr& cond, const Expr& t, const Expr& e) {
-    auto n = std::make_shared<ExprNode>();
-    n->op = OpType::Select; n->a = cond.node; n->b = t.node; n->c = e.node; return Expr(n);
+    ExprArena* owner = cond.arena ? cond.arena : t.arena ? t.arena : e.arena;
+    return Expr(ExprArena::current(owner).intern(OpType::Select, 0, nullptr, cond.node, t.node, e.node), owner);
 }
 
 // Public conditional builder (If expression)
@@ -72,6 +185,14 @@ inline Expr If(const Expr& condition, const Expr& thenExpr, const Expr& elseExpr
     return make_select(condition, thenExpr, elseExpr);
 }
 
+// Widest wire supported; see wide.h for the multi-word value type.
+const int kMaxWireWidth = 256;
+
+// Bits [0, width) set; width 64 (or more) keeps every bit.
+inline long long width_mask(int width) {
+    return width >= 64 ? -1LL : static_cast<long long>((1ULL << width) - 1);
+}
+
 // Expression operator overloads
 inline Expr operator+(const Expr& x, const Expr& y) { return make_binary(OpType::Add, x, y); }
 inline Expr operator-(const Expr& x, const Expr& y) { return make_binary(OpType::Sub, x, y); }
@@ -100,45 +221,42 @@ inline Expr operator>(const Expr& x, const Expr& y) { return make_binary(OpType:
 inline Expr operator>=(const Expr& x, const Expr& y) { return make_binary(OpType::Ge, x, y); }
 
 // Provide mixed operators with integers (on right-hand side)
-inline Expr operator+(const Expr& x, long long y) { return x + Expr(y); }
-inline Expr operator-(const Expr& x, long long y) { return x - Expr(y); }
-inline Expr operator*(const Expr& x, long long y) { return x * Expr(y); }
-inline Expr operator/(const Expr& x, long long y) { return x / Expr(y); }
-inline Expr operator%(const Expr& x, long long y) { return x % Expr(y); }
-inline Expr operator&(const Expr& x, long long y) { return x & Expr(y); }
-inline Expr operator|(const Expr& x, long long y) { return x | Expr(y); }
-inline Expr operator^(const Expr& x, long long y) { return x ^ Expr(y); }
-inline Expr operator<<(const Expr& x, long long y) { return x << Expr(y); }
-inline Expr operator>>(const Expr& x, long long y) { return x >> Expr(y); }
-inline Expr operator==(const Expr& x, long long y) { return x == Expr(y); }
-inline Expr operator!=(const Expr& x, long long y) { return x != Expr(y); }
-inline Expr operator<(const Expr& x, long long y) { return x < Expr(y); }
-inline Expr operator<=(const Expr& x, long long y) { return x <= Expr(y); }
-inline Expr operator>(const Expr& x, long long y) { return x > Expr(y); }
-inline Expr operator>=(const Expr& x, long long y) { return x >= Expr(y); }
+inline Expr operator+(const Expr& x, long long y) { return x + Expr(y, x.arena); }
+inline Expr operator-(const Expr& x, long long y) { return x - Expr(y, x.arena); }
+inline Expr operator*(const Expr& x, long long y) { return x * Expr(y, x.arena); }
+inline Expr operator/(const Expr& x, long long y) { return x / Expr(y, x.arena); }
+inline Expr operator%(const Expr& x, long long y) { return x % Expr(y, x.arena); }
+inline Expr operator&(const Expr& x, long long y) { return x & Expr(y, x.arena); }
+inline Expr operator|(const Expr& x, long long y) { return x | Expr(y, x.arena); }
+inline Expr operator^(const Expr& x, long long y) { return x ^ Expr(y, x.arena); }
+inline Expr operator<<(const Expr& x, long long y) { return x << Expr(y, x.arena); }
+inline Expr operator>>(const Expr& x, long long y) { return x >> Expr(y, x.arena); }
+inline Expr operator==(const Expr& x, long long y) { return x == Expr(y, x.arena); }
+inline Expr operator!=(const Expr& x, long long y) { return x != Expr(y, x.arena); }
+inline Expr operator<(const Expr& x, long long y) { return x < Expr(y, x.arena); }
+inline Expr operator<=(const Expr& x, long long y) { return x <= Expr(y, x.arena); }
+inline Expr operator>(const Expr& x, long long y) { return x > Expr(y, x.arena); }
+inline Expr operator>=(const Expr& x, long long y) { return x >= Expr(y, x.arena); }
 
 // Mixed operators with integers (on left-hand side)
-inline Expr operator+(long long x, const Expr& y) { return Expr(x) + y; }
-inline Expr operator-(long long x, const Expr& y) { return Expr(x) - y; }
-inline Expr operator*(long long x, const Expr& y) { return Expr(x) * y; }
-inline Expr operator/(long long x, const Expr& y) { return Expr(x) / y; }
-inline Expr operator%(long long x, const Expr& y) { return Expr(x) % y; }
-inline Expr operator&(long long x, const Expr& y) { return Expr(x) & y; }
-inline Expr operator|(long long x, const Expr& y) { return Expr(x) | y; }
-inline Expr operator^(long long x, const Expr& y) { return Expr(x) ^ y; }
-inline Expr operator<<(long long x, const Expr& y) { return Expr(x) << y; }
-inline Expr operator>>(long long x, const Expr& y) { return Expr(x) >> y; }
-inline Expr operator==(long long x, const Expr& y) { return Expr(x) == y; }
-inline Expr operator!=(long long x, const Expr& y) { return Expr(x) != y; }
-inline Expr operator<(long long x, const Expr& y) { return Expr(x) < y; }
-inline Expr operator<=(long long x, const Expr& y) { return Expr(x) <= y; }
-inline Expr operator>(long long x, const Expr& y) { return Expr(x) > y; }
-inline Expr operator>=(long long x, const Expr& y) { return Expr(x) >= y; }
-
-// Implementation of wireRef
-inline Expr Expr::wireRef(const Wire* w) {
-    auto n = std::make_shared<ExprNode>();
-    n->op = OpType::WireRef; n->wire = w; return Expr(n);
-}
+inline Expr operator+(long long x, const Expr& y) { return Expr(x, y.arena) + y; }
+inline Expr operator-(long long x, const Expr& y) { return Expr(x, y.arena) - y; }
+inline Expr operator*(long long x, const Expr& y) { return Expr(x, y.arena) * y; }
+inline Expr operator/(long long x, const Expr& y) { return Expr(x, y.arena) / y; }
+inline Expr operator%(long long x, const Expr& y) { return Expr(x, y.arena) % y; }
+inline Expr operator&(long long x, const Expr& y) { return Expr(x, y.arena) & y; }
+inline Expr operator|(long long x, const Expr& y) { return Expr(x, y.arena) | y; }
+inline Expr operator^(long long x, const Expr& y) { return Expr(x, y.arena) ^ y; }
+inline Expr operator<<(long long x, const Expr& y) { return Expr(x, y.arena) << y; }
+inline Expr operator>>(long long x, const Expr& y) { return Expr(x, y.arena) >> y; }
+inline Expr operator==(long long x, const Expr& y) { return Expr(x, y.arena) == y; }
+inline Expr operator!=(long long x, const Expr& y) { return Expr(x, y.arena) != y; }
+inline Expr operator<(long long x, const Expr& y) { return Expr(x, y.arena) < y; }
+inline Expr operator<=(long long x, const Expr& y) { return Expr(x, y.arena) <= y; }
+inline Expr operator>(long long x, const Expr& y) { return Expr(x, y.arena) > y; }
+inline Expr operator>=(long long x, const Expr& y) { return Expr(x, y.arena) >= y; }
+
+// Keep the low `width` bits of x as an unsigned value (x & (2^width - 1)).
+inline Expr Trunc(const Expr& x, int width) { return width >= 64 ? x : x & width_mask(width); }
 
 
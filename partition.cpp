@@ -0,0 +1,241 @@
+#include "partition.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// A register or a written memory, with the cone computing its next state.
+struct StateUnit {
+    std::vector<int> roots;   // slots the clock edge reads
+    std::vector<int> state;   // slots it commits
+    std::vector<int> commits; // indices into nl.commits
+    std::vector<int> writes;  // indices into nl.mem_writes
+    std::vector<int> ops;     // cone, ascending
+    std::vector<int> leaves;  // slots the cone reads that no op writes
+    long long cost {1};
+};
+
+} // namespace
+
+NetlistPartition partition_netlist(const Netlist& nl, int pieces) {
+    if (has_wide_signals(nl)) throw std::invalid_argument("netlist partitioning does not support signals wider than 64 bits");
+    size_t slots = nl.init.size();
+    std::vector<int> writer(slots, -1);
+    for (size_t i = 0; i < nl.ops.size(); ++i) writer[nl.ops[i].dst] = static_cast<int>(i);
+    std::vector<int> memory_base(slots, -1);
+    std::vector<int> memory_depth(slots, 0);
+    for (const MemoryLayout& m : nl.memories) {
+        for (int k = 0; k < m.memory->depth; ++k) memory_base[m.base + k] = m.base;
+        memory_depth[m.base] = m.memory->depth;
+    }
+
+    std::vector<StateUnit> units;
+    for (size_t i = 0; i < nl.commits.size(); ++i) {
+        const Commit& c = nl.commits[i];
+        StateUnit u;
+        u.roots.push_back(c.src);
+        if (c.gate >= 0) u.roots.push_back(c.gate);
+        u.state.push_back(c.dst);
+        u.commits.push_back(static_cast<int>(i));
+        units.push_back(u);
+    }
+    // Write ports of one memory apply in order, so they stay together.
+    for (const MemoryLayout& m : nl.memories) {
+        StateUnit u;
+        for (size_t i = 0; i < nl.mem_writes.size(); ++i) {
+            const MemWrite& w = nl.mem_writes[i];
+            if (w.base != m.base) continue;
+            u.roots.insert(u.roots.end(), {w.addr, w.data, w.enable});
+            u.writes.push_back(static_cast<int>(i));
+        }
+        if (u.writes.empty()) continue;
+        for (int k = 0; k < m.memory->depth; ++k) u.state.push_back(m.base + k);
+        units.push_back(u);
+    }
+    if (units.empty()) return NetlistPartition{};
+    std::vector<int> owner_unit(slots, -1);
+    for (size_t u = 0; u < units.size(); ++u) {
+        for (int s : units[u].state) owner_unit[s] = static_cast<int>(u);
+    }
+
+    // Cones, and the register graph: an edge wherever a cone reads another unit's state.
+    std::vector<size_t> seen(slots, 0);
+    std::vector<std::vector<int>> adjacent(units.size());
+    std::vector<int> stack;
+    for (size_t u = 0; u < units.size(); ++u) {
+        StateUnit& unit = units[u];
+        stack = unit.roots;
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            if (seen[s] == u + 1) continue;
+            seen[s] = u + 1;
+            int i = writer[s];
+            if (i < 0) {
+                unit.leaves.push_back(s);
+                int v = owner_unit[s];
+                if (v >= 0 && v != static_cast<int>(u)) adjacent[u].push_back(v);
+                continue;
+            }
+            unit.ops.push_back(i);
+            const FlatOp& op = nl.ops[i];
+            stack.insert(stack.end(), {op.a, op.b, op.c});
+            if (op.op == OpType::MemRead) {
+                for (int k = 0; k < memory_depth[op.b]; ++k) stack.push_back(op.b + k);
+            }
+        }
+        std::sort(unit.ops.begin(), unit.ops.end());
+        unit.cost = 1 + static_cast<long long>(unit.ops.size());
+    }
+    for (size_t u = 0; u < units.size(); ++u) {
+        for (int v : adjacent[u]) adjacent[v].push_back(static_cast<int>(u));
+    }
+    for (auto& a : adjacent) {
+        std::sort(a.begin(), a.end());
+        a.erase(std::unique(a.begin(), a.end()), a.end());
+    }
+
+    // Breadth-first order keeps connected registers next to each other, so
+    // contiguous runs of it cut few edges.
+    std::vector<int> order;
+    std::vector<char> queued(units.size(), 0);
+    for (size_t start = 0; start < units.size(); ++start) {
+        if (queued[start]) continue;
+        queued[start] = 1;
+        order.push_back(static_cast<int>(start));
+        for (size_t head = order.size() - 1; head < order.size(); ++head) {
+            for (int v : adjacent[order[head]]) {
+                if (queued[v]) continue;
+                queued[v] = 1;
+                order.push_back(v);
+            }
+        }
+    }
+    int k = std::max(1, std::min(pieces, static_cast<int>(units.size())));
+    long long total = 0;
+    for (const StateUnit& u : units) total += u.cost;
+    std::vector<int> piece_of(units.size(), 0);
+    std::vector<long long> load(k, 0);
+    std::vector<int> members(k, 0);
+    long long before = 0;
+    for (int u : order) {
+        int p = static_cast<int>(std::min<long long>(k - 1, (2 * before + units[u].cost) * k / (2 * total)));
+        piece_of[u] = p;
+        load[p] += units[u].cost;
+        ++members[p];
+        before += units[u].cost;
+    }
+    long long limit = total / k + total / k / 10 + 1;
+    std::vector<int> votes(k, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int u : order) {
+            int p = piece_of[u];
+            if (members[p] == 1) continue;
+            for (int v : adjacent[u]) ++votes[piece_of[v]];
+            int best = p;
+            for (int q = 0; q < k; ++q) {
+                if (votes[q] > votes[best] && load[q] + units[u].cost <= limit) best = q;
+            }
+            for (int v : adjacent[u]) votes[piece_of[v]] = 0;
+            if (best == p) continue;
+            piece_of[u] = best;
+            load[p] -= units[u].cost;
+            load[best] += units[u].cost;
+            --members[p];
+            ++members[best];
+        }
+    }
+
+    // Boundary state: committed slots read by a piece other than their owner.
+    NetlistPartition part;
+    part.pieces.resize(k);
+    std::vector<std::vector<int>> piece_units(k);
+    for (size_t u = 0; u < units.size(); ++u) piece_units[piece_of[u]].push_back(static_cast<int>(u));
+    std::vector<std::vector<int>> readers(slots);
+    std::vector<int> read_by(slots, -1);
+    for (int p = 0; p < k; ++p) {
+        for (int u : piece_units[p]) {
+            for (int s : units[u].leaves) {
+                int o = owner_unit[s];
+                if (o < 0 || piece_of[o] == p || read_by[s] == p) continue;
+                read_by[s] = p;
+                readers[s].push_back(p);
+            }
+        }
+    }
+    std::vector<size_t> word(slots, 0);
+    for (size_t s = 0; s < slots; ++s) {
+        if (!readers[s].empty()) word[s] = part.exchange_words++;
+    }
+
+    std::vector<int> local(slots, -1);
+    std::vector<int> in_piece(nl.ops.size(), -1);
+    for (int p = 0; p < k; ++p) {
+        NetlistPiece& piece = part.pieces[p];
+        // Memory cells are mapped as one contiguous range, as MemRead indexes them.
+        auto map = [&](int s) {
+            if (local[s] >= 0) return local[s];
+            int first = memory_base[s] >= 0 ? memory_base[s] : s;
+            int n = memory_base[s] >= 0 ? memory_depth[first] : 1;
+            for (int j = 0; j < n; ++j) {
+                local[first + j] = static_cast<int>(piece.global_slot.size());
+                piece.global_slot.push_back(first + j);
+            }
+            return local[s];
+        };
+        map(0);
+        std::vector<int> ops;
+        for (int u : piece_units[p]) {
+            for (int i : units[u].ops) {
+                if (in_piece[i] == p) continue;
+                if (in_piece[i] >= 0) ++part.duplicated_ops;
+                in_piece[i] = p;
+                ops.push_back(i);
+            }
+        }
+        std::sort(ops.begin(), ops.end());
+        for (int i : ops) {
+            FlatOp op = nl.ops[i];
+            op.a = map(op.a);
+            op.b = map(op.b);
+            op.c = map(op.c);
+            op.dst = map(op.dst);
+            piece.ops.push_back(op);
+        }
+        for (int u : piece_units[p]) {
+            for (int i : units[u].commits) {
+                Commit c = nl.commits[i];
+                c.src = map(c.src);
+                c.dst = map(c.dst);
+                if (c.gate >= 0) c.gate = map(c.gate);
+                piece.commits.push_back(c);
+            }
+            for (int i : units[u].writes) {
+                MemWrite w = nl.mem_writes[i];
+                w.addr = map(w.addr);
+                w.data = map(w.data);
+                w.enable = map(w.enable);
+                w.base = map(w.base);
+                piece.mem_writes.push_back(w);
+            }
+            for (int s : units[u].leaves) map(s);
+            for (int s : units[u].state) {
+                piece.owned.push_back(map(s));
+                if (!readers[s].empty()) piece.exports.emplace_back(local[s], word[s]);
+            }
+        }
+        std::vector<char> written(piece.global_slot.size(), 0);
+        for (const FlatOp& op : piece.ops) written[op.dst] = 1;
+        for (size_t s = 0; s < piece.global_slot.size(); ++s) {
+            int g = piece.global_slot[s];
+            if (!written[s]) piece.leaves.push_back(static_cast<int>(s));
+            if (!readers[g].empty() && std::find(readers[g].begin(), readers[g].end(), p) != readers[g].end()) {
+                piece.imports.emplace_back(static_cast<int>(s), word[g]);
+            }
+        }
+        for (int g : piece.global_slot) local[g] = -1;
+    }
+    return part;
+}
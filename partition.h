@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "netlist.h"
+
+// One piece of a partitioned netlist: the registers and memories it owns and
+// the logic computing their next state, over a compact slot array of its own.
+// Logic feeding registers of several pieces is duplicated into each of them.
+struct NetlistPiece {
+    std::vector<FlatOp> ops;           // piece-local slots, in the netlist's level order
+    std::vector<Commit> commits;
+    std::vector<MemWrite> mem_writes;  // in port order per memory
+    std::vector<int> global_slot;      // netlist slot of each local slot
+    std::vector<int> leaves;           // local slots no op writes: state, inputs and constants
+    std::vector<int> owned;            // local slots of the state this piece commits
+    // Boundary values: after each clock edge the piece writes its exported
+    // state to the exchange words and reads the imported state back from them.
+    std::vector<std::pair<int, size_t>> exports; // (local slot, exchange word)
+    std::vector<std::pair<int, size_t>> imports;
+};
+
+struct NetlistPartition {
+    std::vector<NetlistPiece> pieces;
+    size_t exchange_words {0};  // boundary state words exchanged per cycle
+    size_t duplicated_ops {0};  // extra evaluations of logic shared by several pieces
+};
+
+// Cuts the register-to-register dependency graph of `nl` into at most
+// `pieces` parts of about equal next-state cost. A register or memory and
+// the cone computing its next state always land in the same piece, so the
+// cut falls only on committed state and one exchange per clock edge is all
+// the pieces need. Registers are laid out in breadth-first order over the
+// graph, split into contiguous runs of equal cost, and then moved towards
+// the piece most of their neighbours are in while that stays within 10% of
+// the balance. Combinational logic that feeds no register is left out.
+// Throws std::invalid_argument for netlists with signals wider than 64 bits.
+NetlistPartition partition_netlist(const Netlist& nl, int pieces);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "operations.h"
+
+enum class ProbeAction {
+    Log,     // only record the hit
+    Stop,    // record it and end the run before that cycle's clock edge
+    Capture  // record it and keep the recorded wires' values around that cycle
+};
+
+// A condition compiled into the evaluation schedule next to the wires and
+// tested once per cycle; it fires on every cycle `when` is nonzero.
+struct Probe {
+    std::string name;
+    Expr when;
+    ProbeAction action {ProbeAction::Log};
+    // Capture: cycles kept before and after the cycle it fires.
+    int before {0};
+    int after {0};
+};
+
+// A probe firing when `holds` is 0, e.g. Assert("fifo bound", count <= 16).
+inline Probe Assert(std::string name, const Expr& holds, ProbeAction action = ProbeAction::Stop) {
+    return Probe{std::move(name), !holds, action};
+}
+
+// A probe capturing `before` cycles before and `after` cycles after each
+// cycle `when` is nonzero.
+inline Probe Trigger(std::string name, const Expr& when, int before, int after) {
+    return Probe{std::move(name), when, ProbeAction::Capture, before, after};
+}
+
+struct ProbeHit {
+    size_t probe; // index into SimOptions::probes
+    long long cycle;
+};
+
+// The recorded wires' values over cycles [first, first + rows) around a
+// Capture probe's hit at `cycle`, shaped like simulate()'s result.
+struct ProbeWindow {
+    size_t probe;
+    long long cycle;
+    long long first;
+    std::map<std::string, std::vector<long long>> history;
+};
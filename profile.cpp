@@ -0,0 +1,64 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+
+const char* op_name(OpType op) {
+    static const char* const names[kOpTypeCount] = {
+        "Constant", "WireRef", "Add", "Sub", "Mul", "Div", "Mod", "BitAnd", "BitOr", "BitXor", "BitNot", "Neg",
+        "Shl", "Shr", "LogAnd", "LogOr", "LogNot", "Eq", "Ne", "Lt", "Le", "Gt", "Ge", "Select", "MemRead",
+    };
+    return names[static_cast<int>(op)];
+}
+
+void write_profile_report(const Profile& p, std::ostream& out, size_t top) {
+    if (!p.enabled) {
+        out << "profiling disabled: build simulator.cpp with -DCIRCUIT_PROFILE\n";
+        return;
+    }
+    char line[256];
+    double per_cycle = p.cycles ? 1e6 / p.cycles : 0;
+    std::snprintf(line, sizeof line, "cycles %lld\nelaborate %10.3f ms\nevaluate  %10.3f ms  (%.1f ns/cycle)\ncommit    %10.3f ms  (%.1f ns/cycle)\n",
+                  p.cycles, p.elaborate_ms, p.evaluate_ms, p.evaluate_ms * per_cycle, p.commit_ms, p.commit_ms * per_cycle);
+    out << line;
+
+    long long total = 0;
+    for (long long n : p.op_evals) total += n;
+    out << "\nop evaluations: " << total << "\n";
+    for (int k = 0; k < kOpTypeCount; ++k) {
+        if (!p.op_evals[k]) continue;
+        std::snprintf(line, sizeof line, "  %-10s %14lld  %5.1f%%\n", op_name(static_cast<OpType>(k)), p.op_evals[k], 100.0 * p.op_evals[k] / total);
+        out << line;
+    }
+
+    std::vector<const WireProfile*> order;
+    for (const WireProfile& w : p.wires) order.push_back(&w);
+    std::sort(order.begin(), order.end(), [](const WireProfile* a, const WireProfile* b) { return a->ops > b->ops; });
+    if (order.size() > top) order.resize(top);
+    out << "\nhottest wires:\n";
+    std::snprintf(line, sizeof line, "  %14s %14s %14s  %s\n", "cone ops", "evals", "reads", "wire");
+    out << line;
+    for (const WireProfile* w : order) {
+        std::snprintf(line, sizeof line, "  %14lld %14lld %14lld  ", w->ops, w->evals, w->reads);
+        out << line << w->name << "\n";
+    }
+}
+
+// Frame names may not contain the separators of the folded format.
+static std::string frame(const std::string& name) {
+    std::string f = name;
+    for (char& ch : f) {
+        if (ch == ';' || ch == ' ' || ch == '\n') ch = '_';
+    }
+    return f;
+}
+
+void write_profile_folded(const Profile& p, std::ostream& out) {
+    for (const WireProfile& w : p.wires) {
+        for (int k = 0; k < kOpTypeCount; ++k) {
+            if (w.op_evals[k]) out << "cycle;evaluate;" << frame(w.name) << ';' << op_name(static_cast<OpType>(k)) << ' ' << w.op_evals[k] << '\n';
+        }
+    }
+    if (p.commits) out << "cycle;commit " << p.commits << '\n';
+}
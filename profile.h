@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "operations.h"
+
+// Profiling is compiled in only when simulator.cpp is built with
+// -DCIRCUIT_PROFILE. Otherwise the counters do not exist and
+// Simulator::profile() returns an empty Profile with `enabled` false.
+
+const int kOpTypeCount = static_cast<int>(OpType::MemRead) + 1;
+
+const char* op_name(OpType op);
+
+struct WireProfile {
+    std::string name;
+    long long evals {0}; // evaluations of the op computing the wire
+    long long reads {0}; // op evaluations that read the wire's value instead of recomputing it
+    long long ops {0};   // evaluations of all ops attributed to the wire's logic cone
+    std::array<long long, kOpTypeCount> op_evals {}; // `ops` by OpType
+};
+
+struct Profile {
+    bool enabled {false};
+    long long cycles {0};
+    double elaborate_ms {0}; // Simulator construction
+    double evaluate_ms {0};
+    double commit_ms {0};
+    long long commits {0};                           // state words copied at clock edges
+    std::array<long long, kOpTypeCount> op_evals {}; // by OpType
+    std::vector<WireProfile> wires;                  // in netlist order
+};
+
+// Human-readable summary: phase times, the op histogram and the `top`
+// wires by attributed op evaluations.
+void write_profile_report(const Profile& p, std::ostream& out, size_t top = 20);
+
+// Folded stacks ("cycle;evaluate;wire;op count" and "cycle;commit count"),
+// weighted by op evaluations, for flamegraph.pl and compatible viewers.
+void write_profile_folded(const Profile& p, std::ostream& out);
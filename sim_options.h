@@ -0,0 +1,51 @@
+#pragma once
+
+#include "netlist.h"
+#include "probe.h"
+
+enum class Engine {
+    Interpreter, // flat op array evaluated by a switch loop
+    Jit,         // netlist compiled to native code at construction, see jit.h
+    EventDriven  // only re-evaluates the fanout of slots that changed
+};
+
+enum class Record {
+    Closure, // every wire in the dependency closure of the targets
+    Targets  // only the requested targets
+};
+
+// Engine settings shared by simulate() and Simulator.
+struct SimOptions {
+    Engine engine {Engine::Interpreter};
+    CompileOptions compile;
+    // Which wires trace(), run(cycles, sink) and simulate() report.
+    Record record {Record::Closure};
+    // Threads used to evaluate each level of the netlist, including the caller.
+    // Only Engine::Interpreter runs levels in parallel.
+    int threads {1};
+    // Levels with fewer ops than this run on the calling thread only, since
+    // forking for them costs more than it saves.
+    int parallel_grain {4096};
+    // Demand-driven evaluation for Engine::Interpreter and Engine::Jit: logic
+    // feeding only the untaken branch of an If() or the unneeded operand of
+    // && / || is skipped, as is logic no recorded wire or register needs.
+    // Pays off for designs dominated by wide muxes. The interpreter then
+    // evaluates on one thread.
+    bool lazy {false};
+    // Smallest cone worth a branch, in simple ops (a Div counts as 8, a Mul
+    // as 3); a mispredicted branch costs about as much as a dozen ops.
+    int lazy_min_cost {12};
+    // Hash the committed state after every clock edge during run() and
+    // trace(). Once it repeats a state from the last fast_forward_window
+    // edges, the run is periodic: whole periods are skipped, and the
+    // recorded rows of the last period are replayed into the sink instead of
+    // being evaluated. Stimulus runs never skip, since their inputs change.
+    bool fast_forward {false};
+    int fast_forward_window {64};
+    // Assertions and triggers tested after the evaluation of every cycle of
+    // step(), run() and trace(), see probe.h. Their conditions are lowered
+    // with the targets, so a probe costs its own ops and one test per cycle;
+    // only hits and capture windows are kept. With probes Engine::Jit steps
+    // cycle by cycle, and fast_forward is ignored.
+    std::vector<Probe> probes;
+};
@@ -4,9 +4,13 @@
 #include <string>
 #include <vector>
 
-struct Wire;
+#include "sim_options.h"
 
-std::map<std::string, std::vector<long long>> simulate(const std::vector<const Wire*>& targets, int cycles, bool restore_state = true);
-std::map<std::string, std::vector<long long>> simulate(const Wire& target, int cycles, bool restore_state = true);
+class HistorySink;
+struct Wire;
 
+std::map<std::string, std::vector<long long>> simulate(const std::vector<const Wire*>& targets, int cycles, bool restore_state = true, const SimOptions& options = {});
+std::map<std::string, std::vector<long long>> simulate(const Wire& target, int cycles, bool restore_state = true, const SimOptions& options = {});
 
+// Streaming variant: values go to `sink` cycle by cycle instead of a map.
+void simulate(const std::vector<const Wire*>& targets, int cycles, HistorySink& sink, bool restore_state = true, const SimOptions& options = {});
@@ -0,0 +1,869 @@
+#include "simulator.h"
+#include "wire.h"
+#include "jit.h"
+#include "stimulus.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#ifdef CIRCUIT_PROFILE
+#include <chrono>
+
+struct ProfileCounters {
+    std::chrono::steady_clock::time_point created {std::chrono::steady_clock::now()};
+    std::vector<long long> op_evals; // per op
+    long long cycles {0};
+    long long commits {0};
+    double elaborate_ns {0};
+    double evaluate_ns {0};
+    double commit_ns {0};
+};
+
+// Adds the lifetime of the enclosing scope to a phase total.
+struct PhaseTimer {
+    double& total;
+    std::chrono::steady_clock::time_point start {std::chrono::steady_clock::now()};
+    explicit PhaseTimer(double& t): total(t) {}
+    ~PhaseTimer() { total += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count(); }
+};
+
+static ProfileCounters* make_profile() { return new ProfileCounters(); }
+#define PROFILE_PHASE(field) PhaseTimer profile_timer_(prof_->field)
+#define PROFILE_COUNT(...) __VA_ARGS__
+#else
+struct ProfileCounters {};
+static ProfileCounters* make_profile() { return nullptr; }
+#define PROFILE_PHASE(field)
+#define PROFILE_COUNT(...)
+#endif
+
+// The compile options with the probe conditions added as extra roots.
+static CompileOptions with_probes(const SimOptions& options) {
+    CompileOptions compile = options.compile;
+    for (const Probe& p : options.probes) compile.probes.push_back(p.when);
+    return compile;
+}
+
+Simulator::Simulator(const std::vector<const Wire*>& targets, const SimOptions& options)
+    : prof_(make_profile()), shared_nl_(std::make_shared<const Netlist>(compile_netlist(targets, with_probes(options)))), nl_(shared_nl_.get()), options_(options) {
+    base_nl_ = shared_nl_;
+    revision_ = wire_revisions().load();
+    init();
+    base_jit_ = jit_;
+}
+
+Simulator::Simulator(const Wire& target, const SimOptions& options): Simulator(std::vector<const Wire*>{ &target }, options) {}
+
+Simulator::Simulator(std::shared_ptr<const Netlist> netlist, const SimOptions& options)
+    : prof_(make_profile()), shared_nl_(std::move(netlist)), nl_(shared_nl_.get()), options_(options) {
+    init();
+}
+
+void Simulator::init() {
+    build();
+    reset();
+    PROFILE_COUNT(prof_->op_evals.assign(nl_->ops.size(), 0));
+    PROFILE_COUNT(prof_->elaborate_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - prof_->created).count());
+}
+
+// Everything derived from the netlist; the slot values are left alone.
+void Simulator::build() {
+    if (options_.engine != Engine::Interpreter && has_wide_signals(*nl_)) {
+        throw std::invalid_argument("signals wider than 64 bits are only supported by Engine::Interpreter");
+    }
+    if (options_.probes.size() != nl_->probe_slots.size()) {
+        throw std::invalid_argument("SimOptions::probes does not match the probes the netlist was compiled with");
+    }
+    size_t before = 0;
+    for (const Probe& p : options_.probes) {
+        if (p.before < 0 || p.after < 0) throw std::invalid_argument("probe '" + p.name + "' has a negative capture window");
+        if (p.action != ProbeAction::Capture) continue;
+        capture_ = true;
+        before = std::max(before, static_cast<size_t>(p.before));
+    }
+    for (size_t i = 0; i < nl_->wires.size(); ++i) index_.emplace(nl_->wires[i], i);
+    staged_.resize(nl_->commits.size());
+    mem_staged_.resize(nl_->mem_writes.size());
+    auto record = [this](size_t i) {
+        recorded_slots_.push_back(nl_->wire_slot[i]);
+        recorded_names_.push_back(nl_->wires[i]->name);
+        recorded_widths_.push_back(std::min<int>(nl_->slot_width[nl_->wire_slot[i]], 64));
+    };
+    if (options_.record == Record::Targets) {
+        for (size_t i : nl_->targets) record(i);
+    } else {
+        for (size_t i = 0; i < nl_->wires.size(); ++i) record(i);
+    }
+    row_.resize(recorded_slots_.size());
+    probe_rows_.resize(before * row_.size());
+    build_state_layout();
+    if (options_.fast_forward && nl_->probe_slots.empty()) {
+        size_t window = static_cast<size_t>(std::max(options_.fast_forward_window, 2));
+        ff_hash_.resize(window);
+        ff_state_.resize(window * state_words_);
+        ff_rows_.resize(window * row_.size());
+    }
+    bool gated = false;
+    for (const Commit& c : nl_->commits) gated |= c.gate >= 0;
+    bool levels = options_.engine == Engine::Interpreter && options_.threads > 1;
+    if (options_.engine != Engine::EventDriven && (options_.lazy || (gated && !levels))) {
+        // Recorded wires, memory writes and the commits are all a cycle needs;
+        // without SimOptions::lazy every wire stays current and only gated
+        // next-state logic is skipped.
+        std::vector<int> demanded = recorded_slots_;
+        if (!options_.lazy) demanded = nl_->wire_slot;
+        for (const MemWrite& w : nl_->mem_writes) demanded.insert(demanded.end(), {w.addr, w.data, w.enable});
+        demanded.insert(demanded.end(), nl_->probe_slots.begin(), nl_->probe_slots.end());
+        lazy_ = lazy_schedule(*nl_, demanded, options_.lazy ? options_.lazy_min_cost : std::numeric_limits<int>::max());
+        lazy_skips_.assign(nl_->wires.size(), options_.lazy && options_.record == Record::Targets ? 1 : 0);
+        for (size_t i : nl_->targets) lazy_skips_[i] = 0;
+    }
+    if (options_.engine == Engine::Jit) {
+        // A netlist patched by update() only needs code for the ops it
+        // appended, unless the lazy schedule interleaves them with the rest.
+        if (base_jit_ && !options_.lazy && nl_ != base_nl_.get()) {
+            const std::vector<Commit>& was = base_nl_->commits;
+            bool commits = !std::equal(was.begin(), was.end(), nl_->commits.begin(), [](const Commit& x, const Commit& y) {
+                return x.src == y.src && x.dst == y.dst && x.gate == y.gate;
+            });
+            jit_ = std::make_shared<const JitModule>(*nl_, base_jit_, base_nl_->ops.size(), commits);
+        } else {
+            jit_ = std::make_shared<const JitModule>(*nl_, lazy_);
+        }
+    } else if (options_.engine == Engine::EventDriven) {
+        build_fanout();
+    } else if (levels && lazy_.empty()) {
+        pool_.reset(new ThreadPool(options_.threads));
+    }
+}
+
+Simulator::Simulator(const Simulator& other)
+    : prof_(make_profile()), shared_nl_(other.shared_nl_), nl_(shared_nl_.get()), options_(other.options_), jit_(other.jit_),
+      v_(other.v_), staged_(other.staged_), mem_staged_(other.mem_staged_), recorded_slots_(other.recorded_slots_),
+      recorded_names_(other.recorded_names_), recorded_widths_(other.recorded_widths_), row_(other.row_), index_(other.index_), state_fields_(other.state_fields_),
+      state_words_(other.state_words_), signature_(other.signature_), cycle_(other.cycle_), evaluated_(other.evaluated_),
+      ff_hash_(other.ff_hash_), ff_state_(other.ff_state_), ff_rows_(other.ff_rows_), ff_begin_(other.ff_begin_),
+      hits_(other.hits_), windows_(other.windows_), probe_rows_(other.probe_rows_), open_windows_(other.open_windows_),
+      probe_begin_(other.probe_begin_), probed_cycle_(other.probed_cycle_), capture_(other.capture_), stopped_(other.stopped_), lazy_(other.lazy_), lazy_skips_(other.lazy_skips_), partial_(other.partial_), fanout_begin_(other.fanout_begin_),
+      fanout_(other.fanout_), op_level_(other.op_level_), pending_(other.pending_), scheduled_(other.scheduled_),
+      changed_(other.changed_), full_eval_(other.full_eval_), base_nl_(other.base_nl_), base_jit_(other.base_jit_), edited_(other.edited_),
+      revision_(other.revision_) {
+    if (other.pool_) pool_.reset(new ThreadPool(options_.threads));
+    PROFILE_COUNT(prof_->op_evals.assign(nl_->ops.size(), 0));
+}
+
+Simulator::~Simulator() = default;
+
+bool Simulator::update() {
+    if (!base_nl_) throw std::invalid_argument("update() needs a simulator compiled from wires");
+    unsigned long long now = wire_revisions().load();
+    if (now == revision_) return false;
+    bool edited = false;
+    for (const Wire* w : base_nl_->wires) {
+        if (w->revision <= revision_) continue;
+        edited = true;
+        if (std::find(edited_.begin(), edited_.end(), w) == edited_.end()) edited_.push_back(w);
+    }
+    // New write ports change the memory writes, not just logic, so they
+    // always take the full compile below.
+    bool new_ports = false;
+    for (const MemoryLayout& m : base_nl_->memories) new_ports = new_ports || m.memory->revision > revision_;
+    revision_ = now;
+    if (!edited && !new_ports) return false;
+    // Every patch starts from the compiled netlist, so the appended logic
+    // covers all edits since then and never piles up.
+    CompileOptions compile = with_probes(options_);
+    auto patched = std::make_shared<Netlist>(*base_nl_);
+    if (!new_ports && patch_netlist(*patched, edited_, compile)) {
+        adopt(std::move(patched), true);
+        return true;
+    }
+    std::vector<const Wire*> targets;
+    for (size_t t : base_nl_->targets) targets.push_back(base_nl_->wires[t]);
+    auto compiled = std::make_shared<const Netlist>(compile_netlist(targets, compile));
+    base_jit_.reset();
+    adopt(compiled, false);
+    base_nl_ = compiled;
+    base_jit_ = jit_;
+    edited_.clear();
+    return true;
+}
+
+// Switches to a netlist built by update(). A patched one keeps every slot
+// of the old one, so only the appended slots are initialized; for a
+// recompiled one, registers, inputs, memories and clock counters are
+// copied over by identity, except inputs whose constant was edited.
+void Simulator::adopt(std::shared_ptr<const Netlist> netlist, bool patched) {
+    std::shared_ptr<const Netlist> old = std::move(shared_nl_);
+    std::vector<long long> old_v = std::move(v_);
+    unsigned long long signature = signature_;
+    shared_nl_ = std::move(netlist);
+    nl_ = shared_nl_.get();
+    index_.clear();
+    recorded_slots_.clear();
+    recorded_names_.clear();
+    recorded_widths_.clear();
+    state_fields_.clear();
+    state_words_ = 0;
+    lazy_.clear();
+    lazy_skips_.clear();
+    pool_.reset();
+    capture_ = false;
+    build();
+
+    if (patched) {
+        // Same state layout, so checkpoints taken before still restore.
+        signature_ = signature;
+        size_t first = base_nl_->init.size();
+        v_ = std::move(old_v);
+        v_.resize(nl_->init.size());
+        std::copy(nl_->init.begin() + static_cast<std::ptrdiff_t>(first), nl_->init.end(), v_.begin() + static_cast<std::ptrdiff_t>(first));
+    } else {
+        v_ = nl_->init;
+        auto copy = [&](int to, int from, int width) {
+            for (int k = 0; k < WideValue::words_for(width); ++k) v_[to + k] = old_v[from + k];
+        };
+        std::unordered_map<const Wire*, size_t> was;
+        for (size_t i = 0; i < old->wires.size(); ++i) was.emplace(old->wires[i], i);
+        for (size_t j = 0; j < nl_->wires.size(); ++j) {
+            const Wire* w = nl_->wires[j];
+            auto it = was.find(w);
+            if (it == was.end()) continue;
+            size_t i = it->second;
+            bool edited = std::find(edited_.begin(), edited_.end(), w) != edited_.end();
+            if (nl_->state_slot[j] >= 0 && old->state_slot[i] >= 0) copy(nl_->state_slot[j], old->state_slot[i], w->width);
+            else if (nl_->pokeable[j] && old->pokeable[i] && !edited) copy(nl_->wire_slot[j], old->wire_slot[i], w->width);
+        }
+        for (const MemoryLayout& m : nl_->memories) {
+            for (const MemoryLayout& o : old->memories) {
+                if (o.memory == m.memory) std::copy(old_v.begin() + o.base, old_v.begin() + o.base + m.memory->depth, v_.begin() + m.base);
+            }
+        }
+        for (const ClockLayout& c : nl_->clocks) {
+            for (const ClockLayout& o : old->clocks) {
+                if (o.clock == c.clock) v_[c.counter] = old_v[o.counter];
+            }
+        }
+    }
+    evaluated_ = false;
+    full_eval_ = true;
+    partial_ = false;
+    changed_.clear();
+    open_windows_.clear();
+    probe_begin_ = cycle_;
+    probed_cycle_ = -1;
+    PROFILE_COUNT(prof_->op_evals.resize(nl_->ops.size(), 0));
+}
+
+size_t Simulator::index_of(const Wire& w) const {
+    auto it = index_.find(&w);
+    if (it == index_.end()) throw std::invalid_argument("wire '" + w.name + "' is not part of this simulation");
+    return it->second;
+}
+
+void Simulator::eval_range(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        const FlatOp& op = nl_->ops[i];
+        PROFILE_COUNT(++prof_->op_evals[i]);
+        if (op.width) eval_wide_op(op, nl_->slot_width.data(), v_.data());
+        else if (op.op == OpType::MemRead) v_[op.dst] = eval_mem_read(op, v_.data());
+        else v_[op.dst] = eval_op(op.op, v_[op.a], v_[op.b], v_[op.c]);
+    }
+}
+
+void Simulator::eval_lazy() {
+    for (size_t k = 0; k < lazy_.size(); ++k) {
+        const LazyStep& step = lazy_[k];
+        if (step.op >= 0) eval_range(static_cast<size_t>(step.op), static_cast<size_t>(step.op) + 1);
+        else if ((v_[step.cond] != 0) != step.when) k += static_cast<size_t>(step.skip);
+    }
+}
+
+// A wire the lazy schedule may have skipped is brought up to date by one
+// full evaluation of the cycle.
+void Simulator::ensure_fresh(size_t wire) {
+    if (!partial_ || !lazy_skips_[wire]) return;
+    eval_range(0, nl_->ops.size());
+    partial_ = false;
+}
+
+std::string not_pokeable_message(const Wire& w) {
+    if (w.comb_expr && w.comb_expr->op == OpType::Constant) {
+        return "cannot poke wire '" + w.name + "': it was folded to a constant; list it in CompileOptions::inputs";
+    }
+    return "cannot poke wire '" + w.name + "': it is driven by combinational logic";
+}
+
+void Simulator::build_fanout() {
+    std::vector<size_t> count(nl_->init.size() + 1, 0);
+    // A MemRead reads every cell of its memory, so it is scheduled when any of them changes.
+    auto for_each_read = [this](const FlatOp& op, auto&& f) {
+        f(op.a);
+        if (op.op == OpType::MemRead) {
+            for (long long k = 0; k < nl_->init[op.c]; ++k) f(op.b + static_cast<int>(k));
+            return;
+        }
+        if (op.b != op.a) f(op.b);
+        if (op.c != op.a && op.c != op.b) f(op.c);
+    };
+    for (const FlatOp& op : nl_->ops) for_each_read(op, [&](int s) { ++count[s + 1]; });
+    for (size_t s = 1; s < count.size(); ++s) count[s] += count[s - 1];
+    fanout_begin_ = count;
+    fanout_.resize(count.back());
+    for (size_t i = 0; i < nl_->ops.size(); ++i) {
+        for_each_read(nl_->ops[i], [&](int s) { fanout_[count[s]++] = static_cast<int>(i); });
+    }
+
+    op_level_.resize(nl_->ops.size());
+    for (size_t l = 0; l + 1 < nl_->level_begin.size(); ++l) {
+        for (size_t i = nl_->level_begin[l]; i < nl_->level_begin[l + 1]; ++i) op_level_[i] = static_cast<int>(l);
+    }
+    pending_.assign(nl_->level_begin.empty() ? 0 : nl_->level_begin.size() - 1, {});
+    scheduled_.assign(nl_->ops.size(), 0);
+}
+
+void Simulator::schedule_readers(int slot) {
+    for (size_t k = fanout_begin_[slot]; k < fanout_begin_[slot + 1]; ++k) {
+        int i = fanout_[k];
+        if (scheduled_[i]) continue;
+        scheduled_[i] = 1;
+        pending_[op_level_[i]].push_back(i);
+    }
+}
+
+void Simulator::evaluate_events() {
+    if (full_eval_) {
+        eval_range(0, nl_->ops.size());
+        full_eval_ = false;
+        changed_.clear();
+        return;
+    }
+    for (int s : changed_) schedule_readers(s);
+    changed_.clear();
+    // Readers always sit at a higher level than the op they read, so one
+    // ascending sweep settles every change.
+    for (auto& level : pending_) {
+        for (int i : level) {
+            scheduled_[i] = 0;
+            const FlatOp& op = nl_->ops[i];
+            PROFILE_COUNT(++prof_->op_evals[i]);
+            long long nv = op.op == OpType::MemRead ? eval_mem_read(op, v_.data()) : eval_op(op.op, v_[op.a], v_[op.b], v_[op.c]);
+            if (nv == v_[op.dst]) continue;
+            v_[op.dst] = nv;
+            schedule_readers(op.dst);
+        }
+        level.clear();
+    }
+}
+
+void Simulator::evaluate() {
+    if (evaluated_) return;
+    PROFILE_PHASE(evaluate_ns);
+    if (options_.engine == Engine::EventDriven) {
+        evaluate_events();
+    } else if (jit_) {
+        jit_->eval(v_.data());
+        partial_ = !lazy_.empty();
+        PROFILE_COUNT(for (long long& n : prof_->op_evals) ++n);
+    } else if (!lazy_.empty()) {
+        eval_lazy();
+        partial_ = true;
+    } else if (!pool_) {
+        eval_range(0, nl_->ops.size());
+    } else {
+        // Ops within a level only read slots written by earlier levels, so each
+        // level can be split across threads with a join before the next one.
+        size_t grain = static_cast<size_t>(options_.parallel_grain > 0 ? options_.parallel_grain : 1);
+        for (size_t l = 0; l + 1 < nl_->level_begin.size(); ++l) {
+            size_t begin = nl_->level_begin[l], end = nl_->level_begin[l + 1];
+            if (end - begin < 2 * grain) { eval_range(begin, end); continue; }
+            size_t chunk = (end - begin + pool_->size() - 1) / pool_->size();
+            chunk = chunk < grain ? grain : chunk;
+            pool_->parallel_for((end - begin + chunk - 1) / chunk, [&](size_t k) {
+                size_t b = begin + k * chunk;
+                eval_range(b, b + chunk < end ? b + chunk : end);
+            });
+        }
+    }
+    evaluated_ = true;
+}
+
+void Simulator::commit() {
+    PROFILE_PHASE(commit_ns);
+    PROFILE_COUNT(++prof_->cycles; prof_->commits += static_cast<long long>(nl_->commits.size()));
+    if (jit_) {
+        jit_->commit(v_.data());
+        evaluated_ = false;
+        ++cycle_;
+        return;
+    }
+    // Two-phase commit: read every next value before any state slot changes.
+    size_t n = nl_->commits.size();
+    size_t grain = static_cast<size_t>(options_.parallel_grain > 0 ? options_.parallel_grain : 1);
+    if (pool_ && n >= 2 * grain) {
+        pool_->parallel_for((n + grain - 1) / grain, [&](size_t k) {
+            for (size_t i = k * grain; i < n && i < (k + 1) * grain; ++i) staged_[i] = commit_value(nl_->commits[i], v_.data());
+        });
+    } else {
+        for (size_t i = 0; i < n; ++i) staged_[i] = commit_value(nl_->commits[i], v_.data());
+    }
+    for (size_t i = 0; i < nl_->mem_writes.size(); ++i) {
+        const MemWrite& w = nl_->mem_writes[i];
+        mem_staged_[i] = std::make_pair(mem_write_cell(w, v_.data()), v_[w.data]);
+    }
+    if (options_.engine == Engine::EventDriven) {
+        auto apply = [this](int dst, long long value) {
+            if (v_[dst] == value) return;
+            v_[dst] = value;
+            changed_.push_back(dst);
+        };
+        for (size_t i = 0; i < n; ++i) apply(nl_->commits[i].dst, staged_[i]);
+        for (const auto& w : mem_staged_) if (w.first >= 0) apply(w.first, w.second);
+    } else {
+        for (size_t i = 0; i < n; ++i) v_[nl_->commits[i].dst] = staged_[i];
+        for (const auto& w : mem_staged_) if (w.first >= 0) v_[w.first] = w.second;
+    }
+    evaluated_ = false;
+    ++cycle_;
+}
+
+void Simulator::step() {
+    evaluate();
+    stopped_ = check_probes();
+    if (!stopped_) commit();
+}
+
+// Tests every probe on the evaluated cycle_, at most once per cycle, and
+// feeds the capture windows. Returns whether a Stop probe fired.
+bool Simulator::check_probes() {
+    if (nl_->probe_slots.empty() || probed_cycle_ == cycle_) return false;
+    probed_cycle_ = cycle_;
+    if (capture_) {
+        for (size_t i = 0; i < row_.size(); ++i) row_[i] = v_[recorded_slots_[i]];
+        for (auto& open : open_windows_) {
+            ProbeWindow& w = windows_[open.first];
+            for (size_t i = 0; i < row_.size(); ++i) w.history[recorded_names_[i]].push_back(row_[i]);
+            --open.second;
+        }
+        open_windows_.erase(std::remove_if(open_windows_.begin(), open_windows_.end(), [](const std::pair<size_t, int>& o) { return o.second == 0; }),
+                            open_windows_.end());
+    }
+    bool stop = false;
+    for (size_t p = 0; p < nl_->probe_slots.size(); ++p) {
+        if (v_[nl_->probe_slots[p]] == 0) continue;
+        hits_.push_back(ProbeHit{p, cycle_});
+        ProbeAction action = options_.probes[p].action;
+        if (action == ProbeAction::Stop) stop = true;
+        else if (action == ProbeAction::Capture) open_window(p);
+    }
+    if (!probe_rows_.empty()) {
+        long long ring = static_cast<long long>(probe_rows_.size() / row_.size());
+        std::copy(row_.begin(), row_.end(), probe_rows_.begin() + (cycle_ % ring) * row_.size());
+    }
+    return stop;
+}
+
+// Starts a window for `probe` at cycle_ from the ring's earlier rows and
+// the current one (already in row_), unless one is still collecting.
+void Simulator::open_window(size_t probe) {
+    for (const auto& open : open_windows_) {
+        if (windows_[open.first].probe == probe) return;
+    }
+    const Probe& p = options_.probes[probe];
+    ProbeWindow w;
+    w.probe = probe;
+    w.cycle = cycle_;
+    w.first = std::max(cycle_ - p.before, probe_begin_);
+    long long ring = probe_rows_.empty() ? 1 : static_cast<long long>(probe_rows_.size() / row_.size());
+    for (size_t i = 0; i < row_.size(); ++i) {
+        std::vector<long long>& values = w.history[recorded_names_[i]];
+        for (long long c = w.first; c < cycle_; ++c) values.push_back(probe_rows_[(c % ring) * row_.size() + i]);
+        values.push_back(row_[i]);
+    }
+    windows_.push_back(std::move(w));
+    if (p.after > 0) open_windows_.emplace_back(windows_.size() - 1, p.after);
+}
+
+void Simulator::clear_probe_history() {
+    hits_.clear();
+    windows_.clear();
+    open_windows_.clear();
+    probe_begin_ = cycle_;
+    probed_cycle_ = -1;
+    stopped_ = false;
+}
+
+// Looks up the state at the start of cycle_ among the last edges. If it
+// matches the state of cycle c0, every period of cycle_ - c0 cycles from
+// here repeats cycles c0 .. cycle_ - 1, so all whole periods before `end`
+// are skipped, replaying their rows into `sink`. Otherwise the state joins
+// the ring. Returns whether cycles were skipped.
+bool Simulator::skip_periods(long long end, HistorySink* sink) {
+    long long window = static_cast<long long>(ff_hash_.size());
+    size_t slot = static_cast<size_t>(cycle_ % window);
+    long long* snapshot = ff_state_.data() + slot * state_words_;
+    // Packed straight into the ring entry, which is kept if no match is found.
+    pack_state(snapshot);
+    unsigned long long h = 1469598103934665603ull;
+    for (size_t k = 0; k < state_words_; ++k) h = (h ^ static_cast<unsigned long long>(snapshot[k])) * 1099511628211ull;
+    auto same_state = [this, snapshot](const long long* saved) {
+        return std::memcmp(saved, snapshot, state_words_ * sizeof(long long)) == 0;
+    };
+    for (long long p = 1; p < window && cycle_ - p >= ff_begin_; ++p) {
+        size_t s = static_cast<size_t>((cycle_ - p) % window);
+        if (ff_hash_[s] != h || !same_state(ff_state_.data() + s * state_words_)) continue;
+        long long skip = (end - cycle_) / p * p;
+        if (skip == 0) break;
+        for (long long t = 0; sink && t < skip; ++t) {
+            size_t from = static_cast<size_t>((cycle_ - p + t % p) % window);
+            sink->record(cycle_ + t, ff_rows_.data() + from * row_.size());
+        }
+        cycle_ += skip;
+        ff_begin_ = cycle_;
+        return true;
+    }
+    ff_hash_[slot] = h;
+    return false;
+}
+
+void Simulator::run(int cycles) {
+    stopped_ = false;
+    if (!ff_hash_.empty()) {
+        long long end = cycle_ + cycles;
+        ff_begin_ = cycle_;
+        while (cycle_ < end) {
+            if (!skip_periods(end, nullptr)) step();
+        }
+        return;
+    }
+    // Evaluation is a pure function of the inputs and state, so redoing an
+    // already evaluated cycle inside the native loop is harmless.
+    // Profiling times evaluation and commit separately, so it steps instead.
+    if (jit_ && cycles > 0 && !prof_ && nl_->probe_slots.empty()) {
+        jit_->run(v_.data(), cycles);
+        cycle_ += cycles;
+        evaluated_ = false;
+        return;
+    }
+    for (int t = 0; t < cycles && !stopped_; ++t) step();
+}
+
+void Simulator::run(long long cycles, HistorySink& sink) {
+    sink.begin(recorded_names_, recorded_widths_);
+    long long end = cycle_ + cycles;
+    ff_begin_ = cycle_;
+    stopped_ = false;
+    while (cycle_ < end) {
+        if (!ff_hash_.empty() && skip_periods(end, &sink)) continue;
+        evaluate();
+        for (size_t i = 0; i < row_.size(); ++i) row_[i] = v_[recorded_slots_[i]];
+        sink.record(cycle_, row_.data());
+        if (check_probes()) {
+            stopped_ = true;
+            break;
+        }
+        if (!ff_hash_.empty()) {
+            size_t slot = static_cast<size_t>(cycle_ % static_cast<long long>(ff_hash_.size()));
+            std::copy(row_.begin(), row_.end(), ff_rows_.begin() + slot * row_.size());
+        }
+        commit();
+    }
+    sink.end();
+}
+
+std::vector<std::pair<int, size_t>> Simulator::bind_inputs(const Stimulus& stimulus, long long cycles) const {
+    long long rows = static_cast<long long>(stimulus.file().rows());
+    if (cycles > 0 && cycle_ + cycles > rows) {
+        throw std::out_of_range("stimulus has " + std::to_string(rows) + " rows, but the run needs " + std::to_string(cycle_ + cycles));
+    }
+    std::vector<std::pair<int, size_t>> inputs;
+    for (const auto& b : stimulus.bindings()) inputs.emplace_back(nl_->wire_slot[pokeable_index_of(*b.first)], b.second);
+    return inputs;
+}
+
+void Simulator::run(long long cycles, const Stimulus& stimulus) {
+    auto inputs = bind_inputs(stimulus, cycles);
+    stopped_ = false;
+    for (long long t = 0; t < cycles && !stopped_; ++t) {
+        const long long* row = stimulus.file().row(static_cast<size_t>(cycle_));
+        for (const auto& in : inputs) set_input(in.first, row[in.second]);
+        step();
+    }
+}
+
+void Simulator::run(long long cycles, const Stimulus& stimulus, HistorySink& sink) {
+    auto inputs = bind_inputs(stimulus, cycles);
+    sink.begin(recorded_names_, recorded_widths_);
+    stopped_ = false;
+    for (long long t = 0; t < cycles; ++t) {
+        const long long* row = stimulus.file().row(static_cast<size_t>(cycle_));
+        for (const auto& in : inputs) set_input(in.first, row[in.second]);
+        evaluate();
+        for (size_t i = 0; i < row_.size(); ++i) row_[i] = v_[recorded_slots_[i]];
+        sink.record(cycle_, row_.data());
+        if (check_probes()) {
+            stopped_ = true;
+            break;
+        }
+        commit();
+    }
+    sink.end();
+}
+
+std::map<std::string, std::vector<long long>> Simulator::trace(int cycles) {
+    MapSink sink(cycles > 0 ? static_cast<size_t>(cycles) : 0);
+    run(cycles, sink);
+    return std::move(sink.history());
+}
+
+void Simulator::reset() {
+    v_ = nl_->init;
+    cycle_ = 0;
+    evaluated_ = false;
+    full_eval_ = true;
+    clear_probe_history();
+}
+
+size_t Simulator::pokeable_index_of(const Wire& w) const {
+    size_t i = index_of(w);
+    if (!nl_->pokeable[i]) throw std::invalid_argument(not_pokeable_message(w));
+    return i;
+}
+
+void Simulator::poke(const Wire& w, long long value) {
+    size_t i = pokeable_index_of(w);
+    set_input(nl_->wire_slot[i], value);
+}
+
+void Simulator::set_input(int slot, long long value) {
+    int width = nl_->slot_width[slot];
+    if (width > 64) {
+        WideValue wide(value, width);
+        for (int k = 0; k < WideValue::words_for(width); ++k) v_[slot + k] = static_cast<long long>(wide.words[k]);
+        evaluated_ = false;
+        return;
+    }
+    value &= width_mask(width);
+    if (v_[slot] == value) return;
+    v_[slot] = value;
+    if (options_.engine == Engine::EventDriven) changed_.push_back(slot);
+    evaluated_ = false;
+}
+
+long long Simulator::peek(const Wire& w) {
+    size_t i = index_of(w);
+    evaluate();
+    ensure_fresh(i);
+    return v_[nl_->wire_slot[i]];
+}
+
+void Simulator::poke_wide(const Wire& w, const WideValue& value) {
+    size_t i = pokeable_index_of(w);
+    int slot = nl_->wire_slot[i];
+    int width = nl_->slot_width[slot];
+    WideValue fitted = value;
+    fitted.width = width;
+    fitted.truncate();
+    // Narrow wires go through set_input so the event-driven engine sees the change.
+    if (width <= 64) {
+        set_input(slot, fitted.low());
+        return;
+    }
+    for (int k = 0; k < WideValue::words_for(width); ++k) v_[slot + k] = static_cast<long long>(fitted.words[k]);
+    evaluated_ = false;
+}
+
+WideValue Simulator::peek_wide(const Wire& w) {
+    size_t i = index_of(w);
+    evaluate();
+    ensure_fresh(i);
+    int slot = nl_->wire_slot[i];
+    int width = nl_->slot_width[slot];
+    if (width <= 64) return WideValue(v_[slot], std::max(w.width, 64));
+    WideValue r(0, width);
+    for (int k = 0; k < WideValue::words_for(width); ++k) r.words[k] = static_cast<uint64_t>(v_[slot + k]);
+    return r;
+}
+
+void Simulator::build_state_layout() {
+    // Registers, inputs, memory cells and clock counters are the only slots not recomputed every cycle.
+    std::vector<int> slots;
+    for (size_t i = 0; i < nl_->wires.size(); ++i) {
+        if (nl_->pokeable[i]) slots.push_back(nl_->wire_slot[i]);
+        if (nl_->state_slot[i] >= 0) slots.push_back(nl_->state_slot[i]);
+    }
+    for (const MemoryLayout& m : nl_->memories) {
+        for (int k = 0; k < m.memory->depth; ++k) slots.push_back(m.base + k);
+    }
+    for (const ClockLayout& c : nl_->clocks) slots.push_back(c.counter);
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    // Each word of state keeps only the bits its slot's width allows.
+    size_t bits = 0;
+    for (int s : slots) {
+        int width = nl_->slot_width[s];
+        for (int k = 0; k < WideValue::words_for(width); ++k) {
+            int field = std::min(64, width - 64 * k);
+            state_fields_.emplace_back(s + k, field);
+            bits += static_cast<size_t>(field);
+        }
+    }
+    state_words_ = (bits + 63) / 64;
+
+    // FNV-1a over the shape of the netlist and the wire names.
+    unsigned long long h = 1469598103934665603ull;
+    auto mix = [&h](unsigned long long v) { h = (h ^ v) * 1099511628211ull; };
+    mix(nl_->init.size());
+    mix(nl_->ops.size());
+    mix(nl_->commits.size());
+    for (const auto& f : state_fields_) { mix(static_cast<unsigned long long>(f.first)); mix(static_cast<unsigned long long>(f.second)); }
+    for (const Wire* w : nl_->wires) {
+        for (char c : w->name) mix(static_cast<unsigned char>(c));
+        mix(static_cast<unsigned long long>(w->width));
+    }
+    signature_ = h;
+}
+
+Checkpoint Simulator::checkpoint() const {
+    Checkpoint cp;
+    cp.signature = signature_;
+    cp.cycle = cycle_;
+    cp.state.resize(state_words_);
+    pack_state(cp.state.data());
+    return cp;
+}
+
+// Concatenates the state fields' bits, lowest first, into `out`; a field
+// may straddle two words.
+void Simulator::pack_state(long long* out) const {
+    std::fill(out, out + state_words_, 0);
+    size_t pos = 0;
+    for (const auto& f : state_fields_) {
+        uint64_t x = static_cast<uint64_t>(v_[f.first] & width_mask(f.second));
+        size_t w = pos / 64, off = pos % 64;
+        out[w] = static_cast<long long>(static_cast<uint64_t>(out[w]) | x << off);
+        if (off + f.second > 64) out[w + 1] = static_cast<long long>(x >> (64 - off));
+        pos += static_cast<size_t>(f.second);
+    }
+}
+
+void Simulator::unpack_state(const long long* in) {
+    size_t pos = 0;
+    for (const auto& f : state_fields_) {
+        size_t w = pos / 64, off = pos % 64;
+        uint64_t x = static_cast<uint64_t>(in[w]) >> off;
+        if (off + f.second > 64) x |= static_cast<uint64_t>(in[w + 1]) << (64 - off);
+        v_[f.first] = static_cast<long long>(x) & width_mask(f.second);
+        pos += static_cast<size_t>(f.second);
+    }
+}
+
+void Simulator::restore(const Checkpoint& cp) {
+    if (cp.signature != signature_ || cp.state.size() != state_words_) {
+        throw std::invalid_argument("checkpoint was taken from a different circuit");
+    }
+    unpack_state(cp.state.data());
+    cycle_ = cp.cycle;
+    evaluated_ = false;
+    full_eval_ = true;
+    changed_.clear();
+    // Earlier hits stay; the capture ring restarts at the restored cycle.
+    open_windows_.clear();
+    probe_begin_ = cycle_;
+    probed_cycle_ = -1;
+    stopped_ = false;
+}
+
+Profile Simulator::profile() const {
+    Profile p;
+#ifdef CIRCUIT_PROFILE
+    p.enabled = true;
+    p.cycles = prof_->cycles;
+    p.commits = prof_->commits;
+    p.elaborate_ms = prof_->elaborate_ns / 1e6;
+    p.evaluate_ms = prof_->evaluate_ns / 1e6;
+    p.commit_ms = prof_->commit_ns / 1e6;
+
+    // Each op is attributed to the wire it computes, or to the wire or
+    // register reading it; levelized order means one backward pass settles
+    // every intermediate. Shared logic goes to its last reader in op order.
+    std::vector<int> writer(nl_->init.size(), -1);
+    for (size_t i = 0; i < nl_->ops.size(); ++i) writer[nl_->ops[i].dst] = static_cast<int>(i);
+    std::vector<int> owner(nl_->ops.size(), -1);
+    auto claim = [&](int slot, int wire) {
+        int j = writer[slot];
+        if (j >= 0 && owner[j] < 0) owner[j] = wire;
+    };
+    for (size_t w = 0; w < nl_->wires.size(); ++w) claim(nl_->wire_slot[w], static_cast<int>(w));
+    std::vector<int> state_wire(nl_->init.size(), -1);
+    for (size_t w = 0; w < nl_->wires.size(); ++w) {
+        if (nl_->state_slot[w] >= 0) state_wire[nl_->state_slot[w]] = static_cast<int>(w);
+    }
+    for (const Commit& c : nl_->commits) {
+        if (state_wire[c.dst] >= 0) claim(c.src, state_wire[c.dst]);
+    }
+    for (size_t i = nl_->ops.size(); i-- > 0;) {
+        if (owner[i] < 0) continue;
+        claim(nl_->ops[i].a, owner[i]);
+        claim(nl_->ops[i].b, owner[i]);
+        claim(nl_->ops[i].c, owner[i]);
+    }
+
+    std::vector<long long> reads(nl_->init.size(), 0);
+    p.wires.resize(nl_->wires.size());
+    for (size_t i = 0; i < nl_->ops.size(); ++i) {
+        const FlatOp& op = nl_->ops[i];
+        long long n = prof_->op_evals[i];
+        p.op_evals[static_cast<int>(op.op)] += n;
+        int arity = op.op == OpType::Select ? 3 : op.op == OpType::BitNot || op.op == OpType::Neg || op.op == OpType::LogNot || op.op == OpType::MemRead ? 1 : 2;
+        reads[op.a] += n;
+        if (arity > 1 && op.b != op.a) reads[op.b] += n;
+        if (arity > 2 && op.c != op.a && op.c != op.b) reads[op.c] += n;
+        if (owner[i] < 0) continue;
+        WireProfile& wp = p.wires[owner[i]];
+        wp.ops += n;
+        wp.op_evals[static_cast<int>(op.op)] += n;
+    }
+    for (size_t w = 0; w < nl_->wires.size(); ++w) {
+        WireProfile& wp = p.wires[w];
+        int slot = nl_->wire_slot[w];
+        wp.name = nl_->wires[w]->name;
+        wp.evals = writer[slot] >= 0 ? prof_->op_evals[writer[slot]] : 0;
+        wp.reads = reads[slot];
+    }
+#endif
+    return p;
+}
+
+void Simulator::write_back() const {
+    for (size_t i = 0; i < nl_->wires.size(); ++i) {
+        if (nl_->state_slot[i] >= 0) const_cast<Wire*>(nl_->wires[i])->committed_value = v_[nl_->state_slot[i]];
+    }
+    for (const MemoryLayout& m : nl_->memories) {
+        Memory* mem = const_cast<Memory*>(m.memory);
+        std::copy(v_.begin() + m.base, v_.begin() + m.base + mem->depth, mem->contents.begin());
+    }
+}
+
+const MemoryLayout& Simulator::layout_of(const Memory& m) const {
+    for (const MemoryLayout& l : nl_->memories) {
+        if (l.memory == &m) return l;
+    }
+    throw std::invalid_argument("memory '" + m.name + "' is not part of this simulation");
+}
+
+void Simulator::poke(const Memory& m, long long addr, long long value) {
+    const MemoryLayout& l = layout_of(m);
+    if (addr < 0 || addr >= m.depth) throw std::out_of_range("address out of range for memory '" + m.name + "'");
+    set_input(l.base + static_cast<int>(addr), value);
+}
+
+long long Simulator::peek(const Memory& m, long long addr) const {
+    const MemoryLayout& l = layout_of(m);
+    if (addr < 0 || addr >= m.depth) throw std::out_of_range("address out of range for memory '" + m.name + "'");
+    return v_[l.base + static_cast<int>(addr)];
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "checkpoint.h"
+#include "netlist.h"
+#include "profile.h"
+#include "sim_options.h"
+#include "sink.h"
+#include "wide.h"
+
+class JitModule;
+class Stimulus;
+class ThreadPool;
+struct ProfileCounters;
+
+struct Memory;
+struct Wire;
+
+// Error text for poking a wire whose slot is computed or folded.
+std::string not_pokeable_message(const Wire& w);
+
+// A circuit compiled once from a target list and simulated repeatedly.
+// All state lives in the simulator; the wires are only read at construction
+// and only written by write_back().
+class Simulator {
+public:
+    explicit Simulator(const std::vector<const Wire*>& targets, const SimOptions& options = {});
+    explicit Simulator(const Wire& target, const SimOptions& options = {});
+    // A simulator of an already compiled netlist, e.g. one loaded with
+    // NetlistFile; options.compile is ignored. options.probes must list the
+    // probes the netlist was compiled with, in order; their conditions are
+    // not read again.
+    explicit Simulator(std::shared_ptr<const Netlist> netlist, const SimOptions& options = {});
+    // A simulator at the same point as `other` that shares its compiled
+    // netlist and native code, so it costs only a copy of the slot values.
+    // The two then run independently, also on different threads.
+    Simulator(const Simulator& other);
+    Simulator& operator=(const Simulator&) = delete;
+    ~Simulator();
+
+    // Advance one clock edge, unless a Stop probe fires first (see stopped()).
+    void step();
+    // Advance `cycles` clock edges without recording.
+    void run(int cycles);
+    // Advance `cycles` clock edges, streaming each recorded wire's value per
+    // cycle to `sink`. SimOptions::record selects the recorded wires.
+    void run(long long cycles, HistorySink& sink);
+    // Advance `cycles` clock edges, poking the wires bound in `stimulus` from
+    // row cycle() of its file before each one. Throws std::out_of_range if
+    // the file has too few rows and std::invalid_argument if a bound wire
+    // cannot be poked.
+    void run(long long cycles, const Stimulus& stimulus);
+    void run(long long cycles, const Stimulus& stimulus, HistorySink& sink);
+    // Advance `cycles` clock edges, returning each recorded wire's value per cycle.
+    std::map<std::string, std::vector<long long>> trace(int cycles);
+    // Return every slot, including poked inputs, to its value at construction.
+    void reset();
+
+    // Set the committed value of a register, or the value of an input wire:
+    // one not driven at all, or constant-driven and listed in
+    // CompileOptions::inputs (or compiled without optimization). The value
+    // is masked to the wire's width.
+    void poke(const Wire& w, long long value);
+    // Value of `w` in the current cycle; the low 64 bits for wide wires.
+    long long peek(const Wire& w);
+
+    // Committed entry `addr` of a memory read by the circuit. Throws
+    // std::out_of_range for an address outside the memory.
+    void poke(const Memory& m, long long addr, long long value);
+    long long peek(const Memory& m, long long addr) const;
+
+    // Full-width access for wires wider than 64 bits, which only
+    // Engine::Interpreter simulates; narrower wires behave like poke and peek.
+    void poke_wide(const Wire& w, const WideValue& value);
+    WideValue peek_wide(const Wire& w);
+
+    // Capture registers, inputs and the cycle count. Restoring one returns
+    // the simulator exactly to that point, so a long warmup can be run once
+    // and many experiments forked from it. restore() throws
+    // std::invalid_argument for a checkpoint of a different circuit.
+    Checkpoint checkpoint() const;
+    void restore(const Checkpoint& cp);
+
+    // Copy committed state back to the wires and memories.
+    void write_back() const;
+
+    // Counters and phase times gathered since construction. Empty, with
+    // `enabled` false, unless simulator.cpp is built with -DCIRCUIT_PROFILE.
+    Profile profile() const;
+
+    // SimOptions::probes that fired, in order, and the windows captured by
+    // Capture probes; a window still collecting rows grows as the run goes
+    // on. A Capture probe opens no second window while one is collecting.
+    const std::vector<ProbeHit>& probe_hits() const { return hits_; }
+    const std::vector<ProbeWindow>& probe_windows() const { return windows_; }
+    // Whether the last step() or run() ended early at a Stop probe. cycle()
+    // is then the firing cycle, evaluated but without its clock edge; the
+    // next step() or run() resumes there without testing it again.
+    bool stopped() const { return stopped_; }
+
+    // Brings the simulation up to date with wires of the circuit assigned new
+    // drivers (=, <<, enable(), clocked_by()) and memories given new write
+    // ports since construction or the last update(), and returns whether
+    // there were any. Only the logic reading the edited wires is lowered
+    // again (see patch_netlist), and Engine::Jit compiles just that logic
+    // unless SimOptions::lazy is set. An edit changing more than logic, such
+    // as a new write port or pulling new wires into the circuit, recompiles
+    // it instead. Either way the cycle count, registers,
+    // inputs and memories carry over, and an edited input takes its new
+    // value. Throws std::invalid_argument for a combinational loop, leaving
+    // the simulation as it was, or for a simulator of a loaded netlist.
+    bool update();
+
+    const Netlist& netlist() const { return *nl_; }
+    long long cycle() const { return cycle_; }
+
+private:
+    void init();
+    void build();
+    void adopt(std::shared_ptr<const Netlist> netlist, bool patched);
+    size_t index_of(const Wire& w) const;
+    size_t pokeable_index_of(const Wire& w) const;
+    void evaluate();
+    void eval_range(size_t begin, size_t end);
+    void eval_lazy();
+    void ensure_fresh(size_t wire);
+    void build_fanout();
+    void schedule_readers(int slot);
+    void evaluate_events();
+    void commit();
+    void set_input(int slot, long long value);
+    const MemoryLayout& layout_of(const Memory& m) const;
+    std::vector<std::pair<int, size_t>> bind_inputs(const Stimulus& stimulus, long long cycles) const;
+    void build_state_layout();
+    void pack_state(long long* out) const;
+    void unpack_state(const long long* in);
+    bool skip_periods(long long end, HistorySink* sink);
+    bool check_probes();
+    void open_window(size_t probe);
+    void clear_probe_history();
+
+    std::unique_ptr<ProfileCounters> prof_; // first, so elaboration timing covers compile_netlist
+    std::shared_ptr<const Netlist> shared_nl_; // shared by copies, like jit_
+    const Netlist* nl_;
+    SimOptions options_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::shared_ptr<const JitModule> jit_;
+    std::vector<long long> v_;
+    std::vector<long long> staged_;
+    std::vector<std::pair<int, long long>> mem_staged_; // (cell or -1, value) per write port
+    std::vector<int> recorded_slots_;
+    std::vector<std::string> recorded_names_;
+    std::vector<int> recorded_widths_; // bits of each recorded value, at most 64
+    std::vector<long long> row_;
+    std::unordered_map<const Wire*, size_t> index_;
+    std::vector<std::pair<int, int>> state_fields_; // (slot, bits) of mutable slots, in slot order
+    size_t state_words_ {0};                        // 64-bit words holding all fields packed
+    unsigned long long signature_ {0};
+    long long cycle_ {0};
+    bool evaluated_ {false};
+
+    // SimOptions::fast_forward: a ring of the last edges' committed state and
+    // recorded rows, entry c % window for cycle c, valid from ff_begin_.
+    std::vector<unsigned long long> ff_hash_;
+    std::vector<long long> ff_state_;
+    std::vector<long long> ff_rows_;
+    long long ff_begin_ {0};
+
+    // SimOptions::probes: what fired, the recorded rows of the last
+    // probe_rows_.size() / row_.size() cycles for Capture windows (entry
+    // c % that for cycle c, valid from probe_begin_) and the windows still
+    // collecting rows, as (index into windows_, rows left).
+    std::vector<ProbeHit> hits_;
+    std::vector<ProbeWindow> windows_;
+    std::vector<long long> probe_rows_;
+    std::vector<std::pair<size_t, int>> open_windows_;
+    long long probe_begin_ {0};
+    long long probed_cycle_ {-1}; // last cycle whose probes were tested
+    bool capture_ {false};
+    bool stopped_ {false};
+
+    // SimOptions::lazy: the schedule, and which wires it may leave stale.
+    std::vector<LazyStep> lazy_;
+    std::vector<char> lazy_skips_;
+    bool partial_ {false}; // the last evaluation ran lazy_
+
+    // Engine::EventDriven bookkeeping.
+    std::vector<size_t> fanout_begin_;       // readers of slot s are fanout_[fanout_begin_[s], fanout_begin_[s + 1])
+    std::vector<int> fanout_;                // op indices
+    std::vector<int> op_level_;
+    std::vector<std::vector<int>> pending_;  // scheduled ops per level
+    std::vector<char> scheduled_;
+    std::vector<int> changed_;               // slots written by commits or pokes since the last evaluation
+    bool full_eval_ {true};
+
+    // update(): the netlist as compiled from the wires and its native code,
+    // which patches build on, the wires edited since, and the wire revision
+    // the simulation reflects. base_nl_ is null for a loaded netlist.
+    std::shared_ptr<const Netlist> base_nl_;
+    std::shared_ptr<const JitModule> base_jit_;
+    std::vector<const Wire*> edited_;
+    unsigned long long revision_ {0};
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Receives wire values while a simulation runs, so long runs do not have to
+// keep their whole history in memory.
+class HistorySink {
+public:
+    virtual ~HistorySink() = default;
+    // Called before the first cycle with the recorded wires, in record() order,
+    // and the bits of each one's values: its width, or 64 for wider wires.
+    virtual void begin(const std::vector<std::string>& names, const std::vector<int>& widths) {
+        (void)names;
+        (void)widths;
+    }
+    // One cycle's values, one per name passed to begin().
+    virtual void record(long long cycle, const long long* values) = 0;
+    // Called after the last cycle of a run.
+    virtual void end() {}
+};
+
+// Collects histories into the map shape returned by simulate().
+class MapSink : public HistorySink {
+public:
+    explicit MapSink(size_t reserve_cycles = 0): reserve_(reserve_cycles) {}
+
+    void begin(const std::vector<std::string>& names, const std::vector<int>&) override {
+        // Resolve each wire's buffer once instead of looking it up by name every cycle.
+        records_.clear();
+        for (const std::string& n : names) {
+            records_.push_back(&history_[n]);
+            records_.back()->reserve(records_.back()->size() + reserve_);
+        }
+    }
+
+    void record(long long, const long long* values) override {
+        for (size_t i = 0; i < records_.size(); ++i) records_[i]->push_back(values[i]);
+    }
+
+    std::map<std::string, std::vector<long long>>& history() { return history_; }
+
+private:
+    size_t reserve_;
+    std::map<std::string, std::vector<long long>> history_;
+    std::vector<std::vector<long long>*> records_;
+};
+
+struct ValueChange {
+    long long cycle;
+    long long value;
+};
+
+// Change-only encoding: keeps a wire's value only in cycles where it differs
+// from the previous cycle, which is far smaller for wires that rarely toggle.
+class ValueChangeSink : public HistorySink {
+public:
+    void begin(const std::vector<std::string>& names, const std::vector<int>&) override {
+        records_.clear();
+        for (const std::string& n : names) records_.push_back(&changes_[n]);
+        last_.assign(names.size(), 0);
+        first_ = true;
+    }
+
+    void record(long long cycle, const long long* values) override {
+        for (size_t i = 0; i < records_.size(); ++i) {
+            if (!first_ && values[i] == last_[i]) continue;
+            records_[i]->push_back(ValueChange{cycle, values[i]});
+            last_[i] = values[i];
+        }
+        last_cycle_ = cycle;
+        first_ = false;
+    }
+
+    const std::map<std::string, std::vector<ValueChange>>& changes() const { return changes_; }
+
+    // Rebuild one value per cycle, as simulate() would have returned it.
+    std::map<std::string, std::vector<long long>> expand() const {
+        std::map<std::string, std::vector<long long>> out;
+        if (first_) return out;
+        for (const auto& kv : changes_) {
+            std::vector<long long>& values = out[kv.first];
+            const std::vector<ValueChange>& ch = kv.second;
+            for (size_t k = 0; k < ch.size(); ++k) {
+                long long until = k + 1 < ch.size() ? ch[k + 1].cycle : last_cycle_ + 1;
+                values.insert(values.end(), static_cast<size_t>(until - ch[k].cycle), ch[k].value);
+            }
+        }
+        return out;
+    }
+
+private:
+    std::map<std::string, std::vector<ValueChange>> changes_;
+    std::vector<std::vector<ValueChange>*> records_;
+    std::vector<long long> last_;
+    long long last_cycle_ {0};
+    bool first_ {true};
+};
+
+// Calls a function for every cycle.
+class CallbackSink : public HistorySink {
+public:
+    using Callback = std::function<void(long long cycle, const long long* values)>;
+
+    explicit CallbackSink(Callback f): f_(std::move(f)) {}
+
+    void record(long long cycle, const long long* values) override { f_(cycle, values); }
+
+private:
+    Callback f_;
+};
+
+// Buffers up to `chunk_cycles` cycles row-major and hands each full chunk
+// (and the final partial one) to a function, bounding memory for any run length.
+class ChunkedSink : public HistorySink {
+public:
+    // values[k * width + i] is wire i in cycle first_cycle + k.
+    using Flush = std::function<void(long long first_cycle, size_t cycles, size_t width, const long long* values)>;
+
+    ChunkedSink(size_t chunk_cycles, Flush f): chunk_(chunk_cycles ? chunk_cycles : 1), f_(std::move(f)) {}
+
+    void begin(const std::vector<std::string>& names, const std::vector<int>&) override {
+        width_ = names.size();
+        buffer_.clear();
+        buffer_.reserve(chunk_ * width_);
+    }
+
+    void record(long long cycle, const long long* values) override {
+        if (buffer_.empty()) first_ = cycle;
+        buffer_.insert(buffer_.end(), values, values + width_);
+        if (buffer_.size() == chunk_ * width_) flush();
+    }
+
+    void end() override { flush(); }
+
+private:
+    void flush() {
+        if (buffer_.empty()) return;
+        f_(first_, width_ ? buffer_.size() / width_ : 0, width_, buffer_.data());
+        buffer_.clear();
+    }
+
+    size_t chunk_;
+    Flush f_;
+    size_t width_ {0};
+    long long first_ {0};
+    std::vector<long long> buffer_;
+};
+
+// Writes `cycle,<wire>...` CSV rows to a stream as the simulation runs.
+class CsvWriter : public HistorySink {
+public:
+    explicit CsvWriter(std::ostream& out): out_(out) {}
+
+    void begin(const std::vector<std::string>& names, const std::vector<int>&) override {
+        width_ = names.size();
+        out_ << "cycle";
+        for (const std::string& n : names) out_ << ',' << n;
+        out_ << '\n';
+    }
+
+    void record(long long cycle, const long long* values) override {
+        out_ << cycle;
+        for (size_t i = 0; i < width_; ++i) out_ << ',' << values[i];
+        out_ << '\n';
+    }
+
+    void end() override { out_.flush(); }
+
+private:
+    std::ostream& out_;
+    size_t width_ {0};
+};
@@ -0,0 +1,158 @@
+#include "stimulus.h"
+#include "wire.h"
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The row data is used in place from the mapping.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "stimulus files are little-endian");
+
+static const char kStimulusMagic[4] = {'S', 'T', 'M', '1'};
+
+// Rows are flushed to the file in chunks of about this size.
+static const size_t kStimulusChunk = 1 << 16;
+
+static void put64(std::string& out, uint64_t v) {
+    for (int k = 0; k < 8; ++k) out.push_back(static_cast<char>(v >> (8 * k)));
+}
+
+static uint64_t get64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int k = 0; k < 8; ++k) v |= static_cast<uint64_t>(p[k]) << (8 * k);
+    return v;
+}
+
+StimulusFile::StimulusFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open '" + path + "'");
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < 12) {
+        ::close(fd);
+        throw std::runtime_error("stimulus: '" + path + "' is not a stimulus file");
+    }
+    map_size_ = static_cast<size_t>(st.st_size);
+    map_ = ::mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        throw std::runtime_error("cannot map '" + path + "'");
+    }
+    ::madvise(map_, map_size_, MADV_SEQUENTIAL);
+
+    const unsigned char* p = static_cast<const unsigned char*>(map_);
+    auto fail = [&](const char* what) {
+        ::munmap(map_, map_size_);
+        map_ = nullptr;
+        throw std::runtime_error("stimulus: '" + path + "' " + what);
+    };
+    if (std::memcmp(p, kStimulusMagic, sizeof kStimulusMagic) != 0) fail("is not a stimulus file");
+    size_t pos = sizeof kStimulusMagic;
+    uint64_t width = get64(p + pos);
+    pos += 8;
+    for (uint64_t i = 0; i < width; ++i) {
+        if (map_size_ - pos < 8) fail("is truncated");
+        uint64_t len = get64(p + pos);
+        pos += 8;
+        if (len > map_size_ - pos) fail("is truncated");
+        columns_.emplace_back(reinterpret_cast<const char*>(p + pos), len);
+        pos += len;
+    }
+    pos = (pos + 7) & ~size_t(7);
+    if (pos > map_size_ || (width && (map_size_ - pos) % (8 * width))) fail("is truncated");
+    data_ = reinterpret_cast<const long long*>(p + pos);
+    rows_ = width ? (map_size_ - pos) / (8 * width) : 0;
+}
+
+StimulusFile::~StimulusFile() {
+    if (map_) ::munmap(map_, map_size_);
+}
+
+int StimulusFile::column(const std::string& name) const {
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        if (columns_[i] == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+StimulusWriter::StimulusWriter(const std::string& path, const std::vector<std::string>& columns)
+    : file_(std::fopen(path.c_str(), "wb")), width_(columns.size()) {
+    if (!file_) throw std::runtime_error("cannot open '" + path + "' for writing");
+    buffer_.assign(kStimulusMagic, sizeof kStimulusMagic);
+    put64(buffer_, columns.size());
+    for (const std::string& c : columns) {
+        put64(buffer_, c.size());
+        buffer_ += c;
+    }
+    buffer_.resize((buffer_.size() + 7) & ~size_t(7), '\0');
+}
+
+StimulusWriter::~StimulusWriter() {
+    if (file_) std::fclose(file_);
+}
+
+void StimulusWriter::append(const long long* values) {
+    for (size_t i = 0; i < width_; ++i) put64(buffer_, static_cast<uint64_t>(values[i]));
+    if (buffer_.size() >= kStimulusChunk) {
+        if (std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) throw std::runtime_error("stimulus write failed");
+        buffer_.clear();
+    }
+}
+
+void StimulusWriter::close() {
+    if (!file_) return;
+    bool ok = std::fwrite(buffer_.data(), 1, buffer_.size(), file_) == buffer_.size();
+    ok = std::fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    buffer_.clear();
+    if (!ok) throw std::runtime_error("stimulus write failed");
+}
+
+static std::vector<std::string> split_csv(const std::string& line) {
+    std::vector<std::string> fields(1);
+    for (char ch : line) {
+        if (ch == ',') fields.emplace_back();
+        else if (ch != '\r') fields.back() += ch;
+    }
+    return fields;
+}
+
+void import_csv_stimulus(std::istream& csv, const std::string& path) {
+    std::string line;
+    if (!std::getline(csv, line)) throw std::runtime_error("stimulus: CSV input has no header");
+    std::vector<std::string> names = split_csv(line);
+    size_t skip = !names.empty() && names[0] == "cycle" ? 1 : 0;
+    StimulusWriter out(path, std::vector<std::string>(names.begin() + skip, names.end()));
+    std::vector<long long> row(names.size() - skip);
+    for (size_t n = 2; std::getline(csv, line); ++n) {
+        if (line.empty() || line == "\r") continue;
+        std::vector<std::string> fields = split_csv(line);
+        if (fields.size() != names.size()) throw std::runtime_error("stimulus: CSV line " + std::to_string(n) + " has the wrong number of fields");
+        for (size_t i = skip; i < fields.size(); ++i) {
+            size_t used = 0;
+            try {
+                row[i - skip] = std::stoll(fields[i], &used);
+            } catch (const std::exception&) {
+                used = 0;
+            }
+            if (used == 0 || used != fields[i].size()) throw std::runtime_error("stimulus: CSV line " + std::to_string(n) + ": bad value '" + fields[i] + "'");
+        }
+        out.append(row.data());
+    }
+    out.close();
+}
+
+Stimulus& Stimulus::bind(const Wire& w) { return bind(w, w.name); }
+
+Stimulus& Stimulus::bind(const Wire& w, const std::string& column) {
+    int c = file_.column(column);
+    if (c < 0) throw std::invalid_argument("stimulus has no column '" + column + "'");
+    bindings_.emplace_back(&w, static_cast<size_t>(c));
+    return *this;
+}
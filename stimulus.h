@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdio>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct Wire;
+
+// Binary stimulus trace (".stim"): the magic "STM1", a 64-bit column count,
+// each column name as a 64-bit length and its bytes, zero padding to a
+// multiple of 8 bytes, then one row of native 64-bit values per cycle. All
+// integers are little-endian; the row data is used in place, so the format
+// is only read on little-endian hosts.
+//
+// StimulusFile maps the file read-only, so rows are read straight from the
+// page cache and a trace may be far larger than memory.
+class StimulusFile {
+public:
+    // Throws std::runtime_error if the file cannot be mapped or is malformed.
+    explicit StimulusFile(const std::string& path);
+    ~StimulusFile();
+
+    StimulusFile(const StimulusFile&) = delete;
+    StimulusFile& operator=(const StimulusFile&) = delete;
+
+    const std::vector<std::string>& columns() const { return columns_; }
+    // Index of the column called `name`, or -1.
+    int column(const std::string& name) const;
+    size_t rows() const { return rows_; }
+    // The columns().size() values of row `r`, valid while the file is alive.
+    const long long* row(size_t r) const { return data_ + r * columns_.size(); }
+
+private:
+    void* map_ {nullptr};
+    size_t map_size_ {0};
+    std::vector<std::string> columns_;
+    const long long* data_ {nullptr};
+    size_t rows_ {0};
+};
+
+// Writes a stimulus file one row at a time.
+class StimulusWriter {
+public:
+    // Throws std::runtime_error if the file cannot be opened.
+    StimulusWriter(const std::string& path, const std::vector<std::string>& columns);
+    ~StimulusWriter();
+
+    StimulusWriter(const StimulusWriter&) = delete;
+    StimulusWriter& operator=(const StimulusWriter&) = delete;
+
+    // Appends one row of columns().size() values.
+    void append(const long long* values);
+    // Flushes and closes the file. Throws std::runtime_error if any write failed.
+    void close();
+
+private:
+    std::FILE* file_;
+    size_t width_;
+    std::string buffer_;
+};
+
+// Converts CSV with a header row of column names and one row of integers per
+// cycle into a stimulus file. A leading "cycle" column, as written by
+// CsvWriter, is dropped. Throws std::runtime_error on malformed input.
+void import_csv_stimulus(std::istream& csv, const std::string& path);
+
+// Binds input wires to columns of a StimulusFile. Simulator::run(cycles,
+// stimulus) pokes every bound wire from row N before evaluating cycle N.
+class Stimulus {
+public:
+    explicit Stimulus(const StimulusFile& file): file_(file) {}
+
+    // Drive `w` from `column`, by default the column named after the wire.
+    // Throws std::invalid_argument if there is no such column.
+    Stimulus& bind(const Wire& w);
+    Stimulus& bind(const Wire& w, const std::string& column);
+
+    const StimulusFile& file() const { return file_; }
+    const std::vector<std::pair<const Wire*, size_t>>& bindings() const { return bindings_; }
+
+private:
+    const StimulusFile& file_;
+    std::vector<std::pair<const Wire*, size_t>> bindings_;
+};
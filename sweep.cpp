@@ -0,0 +1,60 @@
+#include "sweep.h"
+#include "sink.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <mutex>
+
+Sweep::Sweep(const std::vector<const Wire*>& targets, const SimOptions& options, int threads)
+    : prototype_(targets, options) {
+    if (threads > 1) pool_.reset(new ThreadPool(threads));
+}
+
+Sweep::Sweep(std::shared_ptr<const Netlist> netlist, const SimOptions& options, int threads)
+    : prototype_(std::move(netlist), options) {
+    if (threads > 1) pool_.reset(new ThreadPool(threads));
+}
+
+Sweep::~Sweep() = default;
+
+int Sweep::threads() const { return pool_ ? pool_->size() : 1; }
+
+void Sweep::run(const std::vector<SweepRun>& runs, const Sinks& sinks, const Done& done) {
+    // Finished simulators go back to a free list, so there is at most one
+    // state copy per thread however many runs there are.
+    std::mutex m;
+    std::vector<std::unique_ptr<Simulator>> idle;
+    std::exception_ptr error;
+    auto one = [&](size_t r) {
+        std::unique_ptr<Simulator> sim;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (!idle.empty()) {
+                sim = std::move(idle.back());
+                idle.pop_back();
+            }
+        }
+        if (!sim) sim.reset(new Simulator(prototype_));
+        try {
+            const SweepRun& run = runs[r];
+            sim->reset();
+            for (const auto& p : run.pokes) sim->poke(*p.first, p.second);
+            HistorySink* sink = sinks ? sinks(r) : nullptr;
+            if (run.stimulus && sink) sim->run(run.cycles, *run.stimulus, *sink);
+            else if (run.stimulus) sim->run(run.cycles, *run.stimulus);
+            else if (sink) sim->run(run.cycles, *sink);
+            else for (long long left = run.cycles; left > 0; left -= std::numeric_limits<int>::max()) sim->run(static_cast<int>(std::min<long long>(left, std::numeric_limits<int>::max())));
+            if (done) done(r, *sim);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m);
+            if (!error) error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(m);
+        idle.push_back(std::move(sim));
+    };
+    if (pool_) pool_->parallel_for(runs.size(), one);
+    else for (size_t r = 0; r < runs.size(); ++r) one(r);
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "simulator.h"
+
+class HistorySink;
+class Stimulus;
+class ThreadPool;
+struct Wire;
+
+// One independent run of a sweep. It starts from the circuit's initial
+// state, applies `pokes` (initial register values, seeds, fixed inputs) and
+// advances `cycles` cycles, poking the inputs bound in `stimulus` from its
+// rows when one is given.
+struct SweepRun {
+    long long cycles {0};
+    std::vector<std::pair<const Wire*, long long>> pokes;
+    const Stimulus* stimulus {nullptr};
+};
+
+// Runs many simulations of one circuit across threads. The circuit is
+// compiled once (for Engine::Jit, built once); every worker then simulates
+// on its own copy of the slot values while sharing the read-only netlist
+// and native code, and reuses that copy for the next run it picks up.
+//
+//     Sweep sweep({ &acc }, options, 8);
+//     std::vector<MapSink> results(runs.size());
+//     sweep.run(runs, [&](size_t r) { return &results[r]; });
+class Sweep {
+public:
+    // Where run `r` streams its recorded wires, or nullptr to record nothing.
+    // Called on the worker executing the run; each run gets its own sink, so
+    // sinks need no locking as long as they are distinct.
+    using Sinks = std::function<HistorySink*(size_t run)>;
+    // Called on the worker after run `r` finishes, with its simulator, e.g.
+    // to peek final values or take a checkpoint.
+    using Done = std::function<void(size_t run, Simulator& sim)>;
+
+    // `threads` counts the calling thread. Each run evaluates with
+    // options.threads threads of its own, so keep that at 1.
+    Sweep(const std::vector<const Wire*>& targets, const SimOptions& options = {}, int threads = 1);
+    // Runs of an already compiled netlist, e.g. one loaded with NetlistFile.
+    Sweep(std::shared_ptr<const Netlist> netlist, const SimOptions& options = {}, int threads = 1);
+    ~Sweep();
+
+    // Executes every run and returns when all are done. If runs throw, the
+    // remaining ones still run and the first exception is rethrown.
+    void run(const std::vector<SweepRun>& runs, const Sinks& sinks = nullptr, const Done& done = nullptr);
+
+    const Netlist& netlist() const { return prototype_.netlist(); }
+    int threads() const;
+
+private:
+    Simulator prototype_;
+    std::unique_ptr<ThreadPool> pool_;
+};
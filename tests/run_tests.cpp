@@ -0,0 +1,474 @@
+// Test driver for the simulator library.
+//
+//   ./run_tests [NAME...]
+//
+// Runs every test, or those whose name contains one of the arguments, and
+// prints one line per test. Exits non-zero if any failed. Engine::Jit cases
+// are skipped when the host compiler ($CIRCUIT_JIT_CXX or `c++`) is missing.
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "../batch.h"
+#include "../checkpoint.h"
+#include "../circuit.h"
+#include "../distributed.h"
+#include "../netlist_file.h"
+#include "../operations.h"
+#include "../simulator.h"
+#include "../waveform.h"
+#include "../wire.h"
+
+using History = std::map<std::string, std::vector<long long>>;
+
+// A failed expectation; the driver reports it and moves on to the next test.
+struct TestFailure : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+#define CHECK(cond)                                                                                          \
+    do {                                                                                                     \
+        if (!(cond)) throw TestFailure(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " #cond); \
+    } while (0)
+
+// Runs `body` and checks that it throws an `E`.
+#define CHECK_THROWS(E, body)                                                                                          \
+    do {                                                                                                               \
+        bool threw_ = false;                                                                                           \
+        try { body; } catch (const E&) { threw_ = true; }                                                              \
+        if (!threw_) throw TestFailure(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": no " #E " from " #body); \
+    } while (0)
+
+// The first cycle and wire at which two histories differ, for failure messages.
+static std::string first_difference(const History& a, const History& b) {
+    for (const auto& [name, values] : a) {
+        auto it = b.find(name);
+        if (it == b.end()) return "'" + name + "' missing";
+        for (size_t t = 0; t < values.size() && t < it->second.size(); ++t) {
+            if (values[t] != it->second[t]) {
+                return "'" + name + "' at cycle " + std::to_string(t) + ": " + std::to_string(values[t]) + " vs " + std::to_string(it->second[t]);
+            }
+        }
+        if (values.size() != it->second.size()) return "'" + name + "' lengths differ";
+    }
+    return a.size() != b.size() ? "wire sets differ" : "";
+}
+
+static void check_same(const std::string& what, const History& a, const History& b) {
+    std::string diff = first_difference(a, b);
+    if (!diff.empty()) throw TestFailure(what + ": " + diff);
+}
+
+static bool jit_available() {
+    static const bool available = [] {
+        const char* cxx = std::getenv("CIRCUIT_JIT_CXX");
+        std::string cmd = std::string(cxx && *cxx ? cxx : "c++") + " --version > /dev/null 2>&1";
+        return std::system(cmd.c_str()) == 0;
+    }();
+    return available;
+}
+
+// A fresh directory for a test's files, removed with them at scope exit.
+class TempDir {
+public:
+    TempDir() {
+        const char* tmp = std::getenv("TMPDIR");
+        path_ = std::string(tmp && *tmp ? tmp : "/tmp") + "/circuit-test-XXXXXX";
+        if (!mkdtemp(&path_[0])) throw std::runtime_error("cannot create a temporary directory");
+    }
+    ~TempDir() {
+        for (const std::string& f : files_) std::remove(f.c_str());
+        rmdir(path_.c_str());
+    }
+    std::string file(const std::string& name) {
+        files_.push_back(path_ + "/" + name);
+        return files_.back();
+    }
+
+private:
+    std::string path_;
+    std::vector<std::string> files_;
+};
+
+// A random synchronous design: inputs, registers of assorted narrow widths,
+// a DAG of combinational wires over them and a memory with one read and one
+// write port. Operands are at most 24 bits wide, so no op overflows.
+struct RandomDesign {
+    Circuit circuit;
+    Memory mem {"mem", 16, 16};
+    std::vector<Wire*> inputs;
+    std::vector<Wire*> regs;
+    std::vector<Wire*> comb;
+    std::vector<const Wire*> targets;
+    std::mt19937 rng;
+
+    explicit RandomDesign(unsigned seed, int n = 60): rng(seed) {
+        static const int kWidths[] = {1, 4, 8, 12, 16, 24};
+        for (int i = 0; i < 3; ++i) inputs.push_back(&circuit.wire("in" + std::to_string(i), rng() % 200, 8));
+        for (int i = 0; i < 8; ++i) {
+            int width = kWidths[rng() % 6];
+            regs.push_back(&circuit.wire("r" + std::to_string(i), rng() & ((1 << width) - 1), width));
+        }
+        for (int i = 0; i < n; ++i) {
+            Wire& w = circuit.wire("n" + std::to_string(i), 0, kWidths[1 + rng() % 5]);
+            w = random_expr(i);
+            comb.push_back(&w);
+        }
+        for (Wire* r : regs) {
+            Expr next = Expr(*r) + 1;
+            for (int k = 0; k < 3; ++k) next = next ^ operand(static_cast<int>(comb.size()));
+            if (rng() % 3 == 0) r->enable(operand(static_cast<int>(comb.size())) & 1);
+            *r << next;
+            targets.push_back(r);
+        }
+        Wire& rd = circuit.wire("rd", 0, 16);
+        rd = mem[operand(static_cast<int>(comb.size())) & 15];
+        mem[Expr(*regs[0]) & 15] << operand(static_cast<int>(comb.size()));
+        Wire& out = circuit.wire("out", 0, 24);
+        out << (Expr(out) ^ Expr(rd));
+        targets.push_back(&out);
+        targets.push_back(comb.back());
+    }
+
+    // An input, register or one of the first `limit` combinational wires.
+    Expr operand(int limit) {
+        size_t pool = inputs.size() + regs.size() + static_cast<size_t>(limit);
+        size_t k = rng() % pool;
+        if (k < inputs.size()) return *inputs[k];
+        k -= inputs.size();
+        if (k < regs.size()) return *regs[k];
+        return *comb[k - regs.size()];
+    }
+
+    // A new driver for combinational wire `i`, reading only earlier ones.
+    Expr random_expr(int i) {
+        Expr x = operand(i), y = operand(i);
+        switch (rng() % 14) {
+            case 0: return x + y;
+            case 1: return x - y;
+            case 2: return x * y;
+            case 3: return x / y;
+            case 4: return x % y;
+            case 5: return x & y;
+            case 6: return x | y;
+            case 7: return x ^ y;
+            case 8: return x << (y & 127);
+            case 9: return x >> (y & 127);
+            case 10: return If(x < y, x, y);
+            case 11: return (x == y) || (x > 7);
+            case 12: return ~x;
+            default: return -x;
+        }
+    }
+};
+
+static SimOptions engine(Engine e) {
+    SimOptions o;
+    o.engine = e;
+    o.record = Record::Targets;
+    return o;
+}
+
+// Every engine and engine setting produces the interpreter's trace.
+static void test_engines_agree_on_random_circuits() {
+    for (unsigned seed = 1; seed <= 8; ++seed) {
+        RandomDesign d(seed);
+        History expected = Simulator(d.targets, engine(Engine::Interpreter)).trace(60);
+
+        std::vector<std::pair<std::string, SimOptions>> configs;
+        configs.emplace_back("event", engine(Engine::EventDriven));
+        SimOptions threads = engine(Engine::Interpreter);
+        threads.threads = 3;
+        threads.parallel_grain = 1;
+        configs.emplace_back("threads", threads);
+        SimOptions lazy = engine(Engine::Interpreter);
+        lazy.lazy = true;
+        lazy.lazy_min_cost = 1;
+        configs.emplace_back("lazy", lazy);
+        SimOptions fast = engine(Engine::Interpreter);
+        fast.fast_forward = true;
+        configs.emplace_back("fast_forward", fast);
+        SimOptions plain = engine(Engine::Interpreter);
+        plain.compile.optimize = false;
+        configs.emplace_back("no-optimize", plain);
+        if (jit_available()) {
+            configs.emplace_back("jit", engine(Engine::Jit));
+            SimOptions jit_lazy = engine(Engine::Jit);
+            jit_lazy.lazy = true;
+            jit_lazy.lazy_min_cost = 1;
+            configs.emplace_back("jit-lazy", jit_lazy);
+        }
+        for (const auto& [name, options] : configs) {
+            check_same("seed " + std::to_string(seed) + " " + name, expected, Simulator(d.targets, options).trace(60));
+        }
+
+        BatchSimulator batch(d.targets, 3);
+        std::vector<History> lanes = batch.trace(60);
+        for (int lane = 0; lane < 3; ++lane) {
+            History targets;
+            for (const auto& [name, values] : expected) targets[name] = lanes[lane].at(name);
+            check_same("seed " + std::to_string(seed) + " batch lane " + std::to_string(lane), expected, targets);
+        }
+    }
+}
+
+// A periodic design gives the same trace whether or not periods are skipped.
+static void test_fast_forward_skips_periods_exactly() {
+    Circuit c;
+    Wire& count = c.wire("count", 0, 4);
+    count << count + 1;
+    Wire& phase = c.wire("phase", 0, 8);
+    phase << If(count == 15, phase ^ 0x5a, phase);
+    std::vector<const Wire*> targets{&count, &phase};
+    SimOptions fast = engine(Engine::Interpreter);
+    fast.fast_forward = true;
+    check_same("fast_forward", Simulator(targets, engine(Engine::Interpreter)).trace(5000), Simulator(targets, fast).trace(5000));
+}
+
+// update() after edits matches a simulator compiled from the edited circuit
+// and started from the same state.
+static void test_update_matches_fresh_compile() {
+    std::vector<Engine> engines{Engine::Interpreter, Engine::EventDriven};
+    if (jit_available()) engines.push_back(Engine::Jit);
+    for (Engine e : engines) {
+        for (unsigned seed = 11; seed <= 14; ++seed) {
+            RandomDesign d(seed);
+            Simulator sim(d.targets, engine(e));
+            sim.run(10);
+            for (int round = 0; round < 3; ++round) {
+                // Redrive a few wires from earlier ones only, keeping the logic acyclic.
+                for (int k = 0; k < 3; ++k) {
+                    int i = static_cast<int>(d.rng() % d.comb.size());
+                    *d.comb[i] = d.random_expr(i);
+                }
+                CHECK(sim.update());
+                CHECK(!sim.update());
+                sim.write_back();
+                Simulator fresh(d.targets, engine(e));
+                check_same("seed " + std::to_string(seed) + " round " + std::to_string(round), fresh.trace(20), sim.trace(20));
+            }
+        }
+    }
+}
+
+// A checkpoint saved to a file restores the exact state, cycle included.
+static void test_checkpoint_round_trip() {
+    TempDir dir;
+    RandomDesign d(21);
+    Simulator sim(d.targets, engine(Engine::Interpreter));
+    sim.run(17);
+    std::string path = dir.file("state.ckpt");
+    save_checkpoint(sim.checkpoint(), path);
+    History expected = sim.trace(30);
+
+    Simulator restored(d.targets, engine(Engine::Interpreter));
+    restored.run(3);
+    restored.restore(load_checkpoint(path));
+    CHECK(restored.cycle() == 17);
+    check_same("restored", expected, restored.trace(30));
+
+    RandomDesign other(22);
+    Simulator different(other.targets, engine(Engine::Interpreter));
+    CHECK_THROWS(std::invalid_argument, different.restore(load_checkpoint(path)));
+    std::ofstream(dir.file("bad.ckpt")) << "not a checkpoint";
+    CHECK_THROWS(std::runtime_error, load_checkpoint(dir.file("bad.ckpt")));
+}
+
+// A saved netlist simulates like the circuit it was compiled from.
+static void test_netlist_file_round_trip() {
+    TempDir dir;
+    RandomDesign d(31);
+    Simulator sim(d.targets, engine(Engine::Interpreter));
+    std::string path = dir.file("design.cnl");
+    save_netlist(sim.netlist(), path);
+    History expected = sim.trace(40);
+
+    NetlistFile file(path);
+    for (const Wire* w : d.targets) CHECK(file.wire(w->name) != nullptr);
+    CHECK(file.memory("mem") != nullptr);
+    Simulator loaded(file.netlist(), engine(Engine::Interpreter));
+    check_same("loaded", expected, loaded.trace(40));
+
+    std::ofstream(dir.file("bad.cnl")) << "CNL1 but nothing else";
+    CHECK_THROWS(std::runtime_error, NetlistFile(dir.file("bad.cnl")));
+}
+
+// Decodes a VcdWriter file into one value per cycle per wire.
+static History read_vcd(const std::string& path, long long cycles, std::map<std::string, int>& widths) {
+    std::ifstream in(path);
+    std::map<std::string, std::string> names; // id -> name
+    std::map<std::string, long long> current;
+    History history;
+    std::string line;
+    long long time = -1;
+    auto fill_to = [&](long long end) {
+        for (auto& [name, values] : history) values.resize(static_cast<size_t>(end), current[name]);
+    };
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string word;
+        words >> word;
+        if (word == "$var") {
+            std::string type, id, name;
+            int width;
+            words >> type >> width >> id >> name;
+            names[id] = name;
+            widths[name] = width;
+            history[name];
+        } else if (!word.empty() && word[0] == '#') {
+            long long t = std::stoll(word.substr(1));
+            if (time >= 0) fill_to(t);
+            time = t;
+        } else if (!word.empty() && word[0] == 'b') {
+            std::string id;
+            words >> id;
+            current[names.at(id)] = static_cast<long long>(std::stoull(word.substr(1), nullptr, 2));
+        } else if (!word.empty() && (word[0] == '0' || word[0] == '1')) {
+            current[names.at(word.substr(1))] = word[0] - '0';
+        }
+    }
+    fill_to(cycles);
+    return history;
+}
+
+// VCD and compact waveform files decode back to the recorded trace.
+static void test_waveform_round_trip() {
+    TempDir dir;
+    RandomDesign d(41);
+    const long long cycles = 300;
+    History expected = Simulator(d.targets, engine(Engine::Interpreter)).trace(cycles);
+    std::map<std::string, int> declared;
+    for (const Wire* w : d.targets) declared[w->name] = w->width;
+
+    std::string cwf = dir.file("run.cwf");
+    {
+        // Short blocks, so the run spans several of them.
+        WaveWriter wave(cwf, 7);
+        Simulator(d.targets, engine(Engine::Interpreter)).run(cycles, wave);
+    }
+    std::map<std::string, int> widths;
+    check_same("cwf", expected, read_wave(cwf, &widths));
+    CHECK(widths == declared);
+
+    std::string vcd = dir.file("run.vcd");
+    {
+        VcdWriter writer(vcd);
+        Simulator(d.targets, engine(Engine::Interpreter)).run(cycles, writer);
+    }
+    widths.clear();
+    check_same("vcd", expected, read_vcd(vcd, cycles, widths));
+    CHECK(widths == declared);
+}
+
+// user-012: a writer closed by the end of its run throws when reused
+// instead of blocking on its stopped writer thread.
+static void test_closed_writer_reuse_throws() {
+    TempDir dir;
+    Circuit c;
+    Wire& count = c.wire("count", 0, 16);
+    count << count + 1;
+    Simulator sim(count);
+    VcdWriter vcd(dir.file("a.vcd"));
+    sim.run(100, vcd);
+    CHECK_THROWS(std::logic_error, sim.run(100000, vcd));
+    WaveWriter wave(dir.file("a.cwf"));
+    sim.run(10, wave);
+    CHECK_THROWS(std::logic_error, sim.run(10, wave));
+}
+
+// user-030: a memory write port added after construction is picked up by
+// update() and written on later clock edges.
+static void test_update_tracks_new_memory_write_ports() {
+    std::vector<Engine> engines{Engine::Interpreter, Engine::EventDriven};
+    if (jit_available()) engines.push_back(Engine::Jit);
+    for (Engine e : engines) {
+        Circuit c;
+        Wire& count = c.wire("count", 0, 8);
+        count << count + 1;
+        Memory mem("mem", 4, 8);
+        Wire& rd = c.wire("rd", 0, 8);
+        rd = mem[0];
+        Simulator sim(std::vector<const Wire*>{&rd, &count}, engine(e));
+        sim.run(5);
+        CHECK(sim.peek(rd) == 0);
+        mem[0] << count;
+        CHECK(sim.update());
+        CHECK(!sim.update());
+        sim.run(5);
+        CHECK(sim.peek(count) == 10);
+        CHECK(sim.peek(mem, 0) == 9);
+        CHECK(sim.peek(rd) == 9);
+    }
+}
+
+// The worker processes of a DistributedSimulator, from /proc.
+static std::vector<pid_t> child_processes() {
+    std::ifstream children("/proc/self/task/" + std::to_string(getpid()) + "/children");
+    std::vector<pid_t> pids;
+    for (pid_t p; children >> p;) pids.push_back(p);
+    return pids;
+}
+
+// user-026: a worker that dies makes run() throw instead of hanging the
+// owner at the next barrier, and the simulator stays unusable after.
+static void test_dead_worker_fails_run() {
+    Circuit c;
+    std::vector<Wire*> regs;
+    for (int i = 0; i < 8; ++i) regs.push_back(&c.wire("r" + std::to_string(i), i));
+    for (int i = 0; i < 8; ++i) *regs[i] << *regs[(i + 1) % 8] + 1;
+    std::vector<const Wire*> targets(regs.begin(), regs.end());
+    Simulator reference(targets);
+    reference.run(100);
+    DistributedSimulator sim(targets, 3);
+    sim.run(100);
+    CHECK(sim.peek(*regs[0]) == reference.peek(*regs[0]));
+    std::vector<pid_t> workers = child_processes();
+    CHECK(!workers.empty());
+    kill(workers[0], SIGKILL);
+    CHECK_THROWS(std::runtime_error, sim.run(100000000));
+    CHECK_THROWS(std::runtime_error, sim.run(1));
+    CHECK_THROWS(std::runtime_error, sim.peek(*regs[0]));
+}
+
+int main(int argc, char** argv) {
+    const std::vector<std::pair<std::string, std::function<void()>>> tests = {
+        {"engines_agree_on_random_circuits", test_engines_agree_on_random_circuits},
+        {"fast_forward_skips_periods_exactly", test_fast_forward_skips_periods_exactly},
+        {"update_matches_fresh_compile", test_update_matches_fresh_compile},
+        {"checkpoint_round_trip", test_checkpoint_round_trip},
+        {"netlist_file_round_trip", test_netlist_file_round_trip},
+        {"waveform_round_trip", test_waveform_round_trip},
+        {"closed_writer_reuse_throws", test_closed_writer_reuse_throws},
+        {"update_tracks_new_memory_write_ports", test_update_tracks_new_memory_write_ports},
+        {"dead_worker_fails_run", test_dead_worker_fails_run},
+    };
+    int run = 0, failed = 0;
+    for (const auto& [name, test] : tests) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) selected = selected || name.find(argv[i]) != std::string::npos;
+        if (!selected) continue;
+        ++run;
+        try {
+            test();
+            std::cout << "ok    " << name << "\n";
+        } catch (const std::exception& e) {
+            ++failed;
+            std::cout << "FAIL  " << name << ": " << e.what() << "\n";
+        }
+    }
+    if (!jit_available()) std::cout << "(Engine::Jit cases skipped: no host compiler)\n";
+    std::cout << run - failed << "/" << run << " passed\n";
+    return failed ? 1 : 0;
+}
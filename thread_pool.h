@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork/join pool: parallel_for hands out task indices from a shared counter to
+// the workers and the calling thread, and returns once every task has run.
+class ThreadPool {
+public:
+    // `threads` counts the calling thread, so ThreadPool(4) starts 3 workers.
+    explicit ThreadPool(int threads) {
+        for (int i = 1; i < threads; ++i) workers_.emplace_back([this] { worker_loop(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        start_cv_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+    void parallel_for(size_t n, const std::function<void(size_t)>& f) {
+        if (workers_.empty() || n <= 1) {
+            for (size_t i = 0; i < n; ++i) f(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            job_ = &f;
+            job_size_ = n;
+            next_.store(0, std::memory_order_relaxed);
+            active_ = workers_.size();
+            ++generation_;
+        }
+        start_cv_.notify_all();
+        work();
+        std::unique_lock<std::mutex> lock(m_);
+        done_cv_.wait(lock, [this] { return active_ == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    void work() {
+        for (size_t i = next_.fetch_add(1); i < job_size_; i = next_.fetch_add(1)) (*job_)(i);
+    }
+
+    void worker_loop() {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_);
+                start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+            }
+            work();
+            std::lock_guard<std::mutex> lock(m_);
+            if (--active_ == 0) done_cv_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex m_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    const std::function<void(size_t)>* job_ {nullptr};
+    size_t job_size_ {0};
+    std::atomic<size_t> next_ {0};
+    size_t active_ {0};
+    uint64_t generation_ {0};
+    bool stop_ {false};
+};
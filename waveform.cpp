@@ -0,0 +1,296 @@
+#include "waveform.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+// Buffered output is handed to the writer thread in chunks of about this size.
+static const size_t kChunkBytes = 1 << 16;
+
+AsyncFileWriter::AsyncFileWriter(const std::string& path, size_t max_pending)
+    : file_(std::fopen(path.c_str(), "wb")), max_pending_(max_pending ? max_pending : 1) {
+    if (!file_) throw std::runtime_error("cannot open '" + path + "' for writing");
+    thread_ = std::thread([this] { loop(); });
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void AsyncFileWriter::write(std::string chunk) {
+    std::unique_lock<std::mutex> lock(m_);
+    // Nothing drains the queue after close(), so waiting for room would hang.
+    if (closing_) throw std::logic_error("write to a closed waveform file");
+    if (chunk.empty()) return;
+    cv_.wait(lock, [this] { return queue_.size() < max_pending_; });
+    queue_.push_back(std::move(chunk));
+    cv_.notify_all();
+}
+
+bool AsyncFileWriter::closed() {
+    std::lock_guard<std::mutex> lock(m_);
+    return closing_;
+}
+
+void AsyncFileWriter::close() {
+    if (!thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        closing_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    if (std::fclose(file_) != 0) failed_ = true;
+    if (failed_) throw std::runtime_error("waveform write failed");
+}
+
+void AsyncFileWriter::loop() {
+    for (;;) {
+        std::string chunk;
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            cv_.wait(lock, [this] { return closing_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            chunk = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        cv_.notify_all();
+        if (std::fwrite(chunk.data(), 1, chunk.size(), file_) != chunk.size()) failed_ = true;
+    }
+}
+
+// VCD identifier codes use the printable characters '!' through '~'.
+static std::string vcd_id(size_t i) {
+    std::string id;
+    do {
+        id += static_cast<char>('!' + i % 94);
+        i /= 94;
+    } while (i);
+    return id;
+}
+
+static void append_vcd_value(std::string& out, long long v, int width, const std::string& id) {
+    unsigned long long u = static_cast<unsigned long long>(v);
+    // 1-bit signals are scalars, which take no 'b' prefix or space.
+    if (width == 1) {
+        out += (u & 1) ? '1' : '0';
+        out += id;
+        out += '\n';
+        return;
+    }
+    out += 'b';
+    if (u == 0) {
+        out += '0';
+    } else {
+        int top = 63;
+        while (!(u >> top & 1)) --top;
+        for (int bit = top; bit >= 0; --bit) out += (u >> bit & 1) ? '1' : '0';
+    }
+    out += ' ';
+    out += id;
+    out += '\n';
+}
+
+VcdWriter::VcdWriter(const std::string& path, std::string timescale): out_(path), timescale_(std::move(timescale)) {}
+
+void VcdWriter::begin(const std::vector<std::string>& names, const std::vector<int>& widths) {
+    if (out_.closed()) throw std::logic_error("VcdWriter: the file was closed by end(); use a new writer for another run");
+    buffer_ += "$timescale " + timescale_ + " $end\n$scope module circuit $end\n";
+    ids_.clear();
+    widths_ = widths;
+    widths_.resize(names.size(), 64);
+    for (size_t i = 0; i < names.size(); ++i) {
+        ids_.push_back(vcd_id(i));
+        buffer_ += "$var wire " + std::to_string(widths_[i]) + " " + ids_.back() + " " + names[i] + " $end\n";
+    }
+    buffer_ += "$upscope $end\n$enddefinitions $end\n";
+    last_.assign(names.size(), 0);
+    first_ = true;
+}
+
+void VcdWriter::record(long long cycle, const long long* values) {
+    if (first_) {
+        buffer_ += "#" + std::to_string(cycle) + "\n$dumpvars\n";
+        for (size_t i = 0; i < ids_.size(); ++i) append_vcd_value(buffer_, values[i], widths_[i], ids_[i]);
+        buffer_ += "$end\n";
+    } else {
+        bool stamped = false;
+        for (size_t i = 0; i < ids_.size(); ++i) {
+            if (values[i] == last_[i]) continue;
+            if (!stamped) buffer_ += "#" + std::to_string(cycle) + "\n";
+            stamped = true;
+            append_vcd_value(buffer_, values[i], widths_[i], ids_[i]);
+        }
+    }
+    std::copy(values, values + ids_.size(), last_.begin());
+    first_ = false;
+    flush_if_full();
+}
+
+void VcdWriter::flush_if_full() {
+    if (buffer_.size() < kChunkBytes) return;
+    out_.write(std::move(buffer_));
+    buffer_.clear();
+}
+
+void VcdWriter::end() {
+    out_.write(std::move(buffer_));
+    buffer_.clear();
+    out_.close();
+}
+
+static void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+static uint64_t zigzag(long long v) {
+    uint64_t u = static_cast<uint64_t>(v);
+    return (u << 1) ^ (v < 0 ? ~uint64_t(0) : 0);
+}
+
+static long long unzigzag(uint64_t u) {
+    return static_cast<long long>((u >> 1) ^ (~(u & 1) + 1));
+}
+
+// Version 2 stores each wire's width after its name; version 1 had none.
+static const char kWaveMagic[4] = {'C', 'W', 'F', '2'};
+static const char kWaveMagicV1[4] = {'C', 'W', 'F', '1'};
+
+WaveWriter::WaveWriter(const std::string& path, size_t block_cycles): out_(path), block_cycles_(block_cycles ? block_cycles : 1) {}
+
+void WaveWriter::begin(const std::vector<std::string>& names, const std::vector<int>& widths) {
+    if (out_.closed()) throw std::logic_error("WaveWriter: the file was closed by end(); use a new writer for another run");
+    std::string header(kWaveMagic, sizeof kWaveMagic);
+    put_varint(header, names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        put_varint(header, names[i].size());
+        header += names[i];
+        put_varint(header, i < widths.size() ? static_cast<uint64_t>(widths[i]) : 64);
+    }
+    out_.write(std::move(header));
+    width_ = names.size();
+    last_.assign(width_, 0);
+    block_len_ = 0;
+}
+
+void WaveWriter::record(long long cycle, const long long* values) {
+    if (block_len_ == 0) {
+        // Blocks are self-contained: start from a full snapshot.
+        block_first_ = block_prev_ = cycle;
+        for (size_t i = 0; i < width_; ++i) put_varint(payload_, zigzag(values[i]));
+        std::copy(values, values + width_, last_.begin());
+    } else {
+        for (size_t i = 0; i < width_; ++i) {
+            if (values[i] == last_[i]) continue;
+            put_varint(payload_, static_cast<uint64_t>(cycle - block_prev_));
+            put_varint(payload_, i);
+            put_varint(payload_, zigzag(static_cast<long long>(static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(last_[i]))));
+            last_[i] = values[i];
+            block_prev_ = cycle;
+            ++block_changes_;
+        }
+    }
+    if (++block_len_ == block_cycles_) flush_block();
+}
+
+void WaveWriter::flush_block() {
+    if (block_len_ == 0) return;
+    std::string block;
+    put_varint(block, zigzag(block_first_));
+    put_varint(block, block_len_);
+    put_varint(block, block_changes_);
+    put_varint(block, payload_.size());
+    block += payload_;
+    out_.write(std::move(block));
+    payload_.clear();
+    block_len_ = 0;
+    block_changes_ = 0;
+}
+
+void WaveWriter::end() {
+    flush_block();
+    out_.close();
+}
+
+namespace {
+
+struct ByteReader {
+    const std::string& data;
+    size_t pos {0};
+
+    bool done() const { return pos >= data.size(); }
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= data.size()) throw std::runtime_error("waveform: truncated file");
+            uint8_t byte = static_cast<uint8_t>(data[pos++]);
+            v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return v;
+        }
+        throw std::runtime_error("waveform: bad varint");
+    }
+};
+
+} // namespace
+
+std::map<std::string, std::vector<long long>> read_wave(const std::string& path, std::map<std::string, int>* widths) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open '" + path + "'");
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    bool has_widths = data.compare(0, sizeof kWaveMagic, std::string(kWaveMagic, sizeof kWaveMagic)) == 0;
+    if (!has_widths && data.compare(0, sizeof kWaveMagicV1, std::string(kWaveMagicV1, sizeof kWaveMagicV1)) != 0) {
+        throw std::runtime_error("waveform: '" + path + "' is not a wave file");
+    }
+    ByteReader r {data, sizeof kWaveMagic};
+
+    size_t width = r.varint();
+    std::vector<std::string> names(width);
+    for (auto& n : names) {
+        size_t len = r.varint();
+        if (len > data.size() - r.pos) throw std::runtime_error("waveform: truncated file");
+        n = data.substr(r.pos, len);
+        r.pos += len;
+        uint64_t bits = has_widths ? r.varint() : 64;
+        if (bits < 1 || bits > 64) throw std::runtime_error("waveform: bad wire width");
+        if (widths) (*widths)[n] = static_cast<int>(bits);
+    }
+    std::map<std::string, std::vector<long long>> history;
+    std::vector<std::vector<long long>*> columns;
+    for (const auto& n : names) columns.push_back(&history[n]);
+
+    std::vector<long long> cur(width);
+    while (!r.done()) {
+        long long first = unzigzag(r.varint());
+        size_t cycles = r.varint();
+        size_t changes = r.varint();
+        r.varint(); // payload size, for readers that skip blocks
+        for (size_t i = 0; i < width; ++i) cur[i] = unzigzag(r.varint());
+        long long at = first;
+        size_t emitted = 0;
+        auto emit_until = [&](long long cycle) {
+            for (; at < cycle && emitted < cycles; ++at, ++emitted) {
+                for (size_t i = 0; i < width; ++i) columns[i]->push_back(cur[i]);
+            }
+        };
+        long long prev = first;
+        for (size_t k = 0; k < changes; ++k) {
+            long long cycle = prev + static_cast<long long>(r.varint());
+            size_t i = r.varint();
+            if (i >= width) throw std::runtime_error("waveform: bad wire index");
+            emit_until(cycle);
+            cur[i] = static_cast<long long>(static_cast<uint64_t>(cur[i]) + static_cast<uint64_t>(unzigzag(r.varint())));
+            prev = cycle;
+        }
+        emit_until(first + static_cast<long long>(cycles));
+    }
+    return history;
+}
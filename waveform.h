@@ -0,0 +1,100 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sink.h"
+
+// Appends byte chunks to a file from a background thread, so formatting in
+// the simulation loop overlaps with I/O. write() only blocks when more than
+// `max_pending` chunks are queued.
+class AsyncFileWriter {
+public:
+    // Throws std::runtime_error if the file cannot be opened.
+    explicit AsyncFileWriter(const std::string& path, size_t max_pending = 8);
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    // Throws std::logic_error after close().
+    void write(std::string chunk);
+    bool closed();
+    // Drains the queue and closes the file. Throws std::runtime_error if any write failed.
+    void close();
+
+private:
+    void loop();
+
+    std::FILE* file_;
+    size_t max_pending_;
+    std::deque<std::string> queue_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool closing_ {false};
+    bool failed_ {false};
+    std::thread thread_;
+};
+
+// Writes a standard VCD file: one timestep per cycle, value changes only.
+// end() closes the file, so a writer records one run; begin() throws
+// std::logic_error if it is reused.
+class VcdWriter : public HistorySink {
+public:
+    explicit VcdWriter(const std::string& path, std::string timescale = "1ns");
+
+    void begin(const std::vector<std::string>& names, const std::vector<int>& widths) override;
+    void record(long long cycle, const long long* values) override;
+    void end() override;
+
+private:
+    void flush_if_full();
+
+    AsyncFileWriter out_;
+    std::string timescale_;
+    std::vector<std::string> ids_;
+    std::vector<int> widths_;
+    std::vector<long long> last_;
+    std::string buffer_;
+    bool first_ {true};
+};
+
+// Compact binary waveform (".cwf"). After a header with the wire names and widths the
+// file is a sequence of independent blocks of up to `block_cycles` cycles.
+// Each block starts with a snapshot of every wire and then lists value
+// changes as varint cycle deltas, wire indices and zigzag value deltas, so
+// quiet wires cost nothing and any block can be decoded on its own. Like
+// VcdWriter, it records one run and throws std::logic_error if reused.
+class WaveWriter : public HistorySink {
+public:
+    explicit WaveWriter(const std::string& path, size_t block_cycles = 4096);
+
+    void begin(const std::vector<std::string>& names, const std::vector<int>& widths) override;
+    void record(long long cycle, const long long* values) override;
+    void end() override;
+
+private:
+    void flush_block();
+
+    AsyncFileWriter out_;
+    size_t block_cycles_;
+    size_t width_ {0};
+    std::vector<long long> last_;
+    std::string payload_;
+    long long block_first_ {0};
+    long long block_prev_ {0};
+    size_t block_len_ {0};
+    size_t block_changes_ {0};
+};
+
+// Decodes a WaveWriter file back into one value per cycle per wire, and
+// fills `widths` with each wire's width if given. Files without widths,
+// written before they were stored, report 64. Throws std::runtime_error on
+// a malformed file.
+std::map<std::string, std::vector<long long>> read_wave(const std::string& path, std::map<std::string, int>* widths = nullptr);
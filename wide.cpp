@@ -0,0 +1,179 @@
+#include "wide.h"
+#include "netlist.h"
+
+#include <algorithm>
+
+std::string WideValue::to_hex() const {
+    static const char digits[] = "0123456789abcdef";
+    std::string s;
+    bool started = false;
+    for (int i = used_words() - 1; i >= 0; --i) {
+        for (int nib = 15; nib >= 0; --nib) {
+            int d = static_cast<int>((words[i] >> (nib * 4)) & 0xf);
+            if (!d && !started) continue;
+            started = true;
+            s += digits[d];
+        }
+    }
+    return "0x" + (started ? s : std::string("0"));
+}
+
+void wide_add(WideValue& r, const WideValue& a, const WideValue& b) {
+    uint64_t carry = 0;
+    for (int i = 0; i < WideValue::kWords; ++i) {
+        uint64_t s = a.words[i] + carry;
+        carry = s < carry;
+        r.words[i] = s + b.words[i];
+        carry += r.words[i] < s;
+    }
+    r.truncate();
+}
+
+void wide_sub(WideValue& r, const WideValue& a, const WideValue& b) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < WideValue::kWords; ++i) {
+        uint64_t d = a.words[i] - b.words[i];
+        uint64_t nb = a.words[i] < b.words[i];
+        r.words[i] = d - borrow;
+        nb |= d < borrow;
+        borrow = nb;
+    }
+    r.truncate();
+}
+
+void wide_mul(WideValue& r, const WideValue& a, const WideValue& b) {
+    uint64_t out[WideValue::kWords] {};
+    int n = r.used_words();
+    for (int i = 0; i < n; ++i) {
+        unsigned __int128 carry = 0;
+        for (int j = 0; i + j < n; ++j) {
+            unsigned __int128 t = static_cast<unsigned __int128>(a.words[i]) * b.words[j] + out[i + j] + carry;
+            out[i + j] = static_cast<uint64_t>(t);
+            carry = t >> 64;
+        }
+    }
+    std::copy(out, out + WideValue::kWords, r.words);
+    r.truncate();
+}
+
+int wide_compare(const WideValue& a, const WideValue& b) {
+    for (int i = WideValue::kWords - 1; i >= 0; --i) {
+        if (a.words[i] != b.words[i]) return a.words[i] < b.words[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+void wide_shl(WideValue& r, const WideValue& a, unsigned long long n) {
+    WideValue out;
+    out.width = r.width;
+    for (int i = 0; i < WideValue::kWords; ++i) out.words[i] = 0;
+    if (n < static_cast<unsigned long long>(kMaxWireWidth)) {
+        int ws = static_cast<int>(n / 64), bs = static_cast<int>(n % 64);
+        for (int i = WideValue::kWords - 1; i >= ws; --i) {
+            uint64_t w = a.words[i - ws] << bs;
+            if (bs && i - ws - 1 >= 0) w |= a.words[i - ws - 1] >> (64 - bs);
+            out.words[i] = w;
+        }
+    }
+    r = out;
+    r.truncate();
+}
+
+// The shift amount `n` holds, saturated to kMaxWireWidth when it does not fit in its low word.
+static unsigned long long shift_amount(const WideValue& n) {
+    for (int i = 1; i < WideValue::kWords; ++i) {
+        if (n.words[i]) return static_cast<unsigned long long>(kMaxWireWidth);
+    }
+    return std::min<unsigned long long>(n.words[0], kMaxWireWidth);
+}
+
+void wide_shl(WideValue& r, const WideValue& a, const WideValue& n) { wide_shl(r, a, shift_amount(n)); }
+
+void wide_shr(WideValue& r, const WideValue& a, const WideValue& n) { wide_shr(r, a, shift_amount(n)); }
+
+void wide_shr(WideValue& r, const WideValue& a, unsigned long long n) {
+    WideValue out;
+    out.width = r.width;
+    for (int i = 0; i < WideValue::kWords; ++i) out.words[i] = 0;
+    if (n < static_cast<unsigned long long>(kMaxWireWidth)) {
+        int ws = static_cast<int>(n / 64), bs = static_cast<int>(n % 64);
+        for (int i = 0; i + ws < WideValue::kWords; ++i) {
+            uint64_t w = a.words[i + ws] >> bs;
+            if (bs && i + ws + 1 < WideValue::kWords) w |= a.words[i + ws + 1] << (64 - bs);
+            out.words[i] = w;
+        }
+    }
+    r = out;
+    r.truncate();
+}
+
+// Restoring long division, one bit per step. Division by zero yields 0 for both results.
+void wide_divmod(WideValue* quot, WideValue* rem, const WideValue& a, const WideValue& b) {
+    WideValue q, r;
+    q.width = r.width = kMaxWireWidth;
+    for (int i = 0; i < WideValue::kWords; ++i) q.words[i] = r.words[i] = 0;
+    if (!b.is_zero()) {
+        for (int bit = kMaxWireWidth - 1; bit >= 0; --bit) {
+            wide_shl(r, r, 1);
+            r.words[0] |= (a.words[bit / 64] >> (bit % 64)) & 1;
+            if (wide_compare(r, b) >= 0) {
+                wide_sub(r, r, b);
+                q.words[bit / 64] |= uint64_t(1) << (bit % 64);
+            }
+        }
+    }
+    if (quot) { int w = quot->width; *quot = q; quot->width = w; quot->truncate(); }
+    if (rem) { int w = rem->width; *rem = r; rem->width = w; rem->truncate(); }
+}
+
+static WideValue load(const long long* v, int slot, int slot_width, int width) {
+    if (slot_width <= 64) return WideValue(v[slot], width);
+    WideValue x;
+    x.width = width;
+    int n = WideValue::words_for(slot_width);
+    for (int i = 0; i < WideValue::kWords; ++i) x.words[i] = i < n ? static_cast<uint64_t>(v[slot + i]) : 0;
+    x.truncate();
+    return x;
+}
+
+void eval_wide_op(const FlatOp& op, const unsigned short* slot_width, long long* v) {
+    int wa = slot_width[op.a], wb = slot_width[op.b], wc = slot_width[op.c];
+    int width = std::max<int>(op.width, std::max(wa, std::max(wb, wc)));
+    width = std::min(width, kMaxWireWidth);
+    WideValue a = load(v, op.a, wa, width), b = load(v, op.b, wb, width), c = load(v, op.c, wc, width);
+    WideValue r(0, width);
+    switch (op.op) {
+        case OpType::Constant:
+        case OpType::WireRef: r = a; break;
+        case OpType::Add: wide_add(r, a, b); break;
+        case OpType::Sub: wide_sub(r, a, b); break;
+        case OpType::Mul: wide_mul(r, a, b); break;
+        case OpType::Div: wide_divmod(&r, nullptr, a, b); break;
+        case OpType::Mod: wide_divmod(nullptr, &r, a, b); break;
+        case OpType::BitAnd: for (int i = 0; i < WideValue::kWords; ++i) r.words[i] = a.words[i] & b.words[i]; break;
+        case OpType::BitOr: for (int i = 0; i < WideValue::kWords; ++i) r.words[i] = a.words[i] | b.words[i]; break;
+        case OpType::BitXor: for (int i = 0; i < WideValue::kWords; ++i) r.words[i] = a.words[i] ^ b.words[i]; break;
+        case OpType::BitNot: for (int i = 0; i < WideValue::kWords; ++i) r.words[i] = ~a.words[i]; r.truncate(); break;
+        case OpType::Neg: wide_sub(r, WideValue(0, width), a); break;
+        case OpType::Shl: wide_shl(r, a, b); break;
+        case OpType::Shr: wide_shr(r, a, b); break;
+        case OpType::LogAnd: r = WideValue(!a.is_zero() && !b.is_zero(), width); break;
+        case OpType::LogOr: r = WideValue(!a.is_zero() || !b.is_zero(), width); break;
+        case OpType::LogNot: r = WideValue(a.is_zero(), width); break;
+        case OpType::Eq: r = WideValue(a == b, width); break;
+        case OpType::Ne: r = WideValue(a != b, width); break;
+        case OpType::Lt: r = WideValue(wide_compare(a, b) < 0, width); break;
+        case OpType::Le: r = WideValue(wide_compare(a, b) <= 0, width); break;
+        case OpType::Gt: r = WideValue(wide_compare(a, b) > 0, width); break;
+        case OpType::Ge: r = WideValue(wide_compare(a, b) >= 0, width); break;
+        case OpType::Select: r = a.is_zero() ? c : b; break;
+        case OpType::MemRead: break; // memories are at most 64 bits wide and never take this path
+    }
+    if (op.width <= 64) {
+        v[op.dst] = static_cast<long long>(r.words[0]) & width_mask(op.width);
+        return;
+    }
+    r.width = op.width;
+    r.truncate();
+    for (int i = 0; i < WideValue::words_for(op.width); ++i) v[op.dst + i] = static_cast<long long>(r.words[i]);
+}
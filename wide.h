@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "operations.h"
+
+struct FlatOp;
+
+// Unsigned multi-word integer of up to kMaxWireWidth bits held inline, with
+// no heap traffic, as little-endian words. Bits at and above `width` are always zero.
+struct WideValue {
+    static const int kWords = kMaxWireWidth / 64;
+
+    int width {64};
+    uint64_t words[kWords] {};
+
+    WideValue() = default;
+    // `v` sign-extended to `width_` bits, so -1 is all ones at any width.
+    WideValue(long long v, int width_): width(width_) {
+        for (int i = 0; i < kWords; ++i) words[i] = v < 0 ? ~uint64_t(0) : 0;
+        words[0] = static_cast<uint64_t>(v);
+        truncate();
+    }
+
+    static int words_for(int width) { return (width + 63) / 64; }
+    int used_words() const { return words_for(width); }
+
+    void truncate() {
+        for (int i = used_words(); i < kWords; ++i) words[i] = 0;
+        if (width % 64) words[used_words() - 1] &= (uint64_t(1) << (width % 64)) - 1;
+    }
+
+    bool is_zero() const {
+        for (uint64_t w : words) if (w) return false;
+        return true;
+    }
+
+    long long low() const { return static_cast<long long>(words[0]); }
+
+    bool operator==(const WideValue& o) const {
+        for (int i = 0; i < kWords; ++i) if (words[i] != o.words[i]) return false;
+        return true;
+    }
+    bool operator!=(const WideValue& o) const { return !(*this == o); }
+
+    // Value as 0x-prefixed hexadecimal.
+    std::string to_hex() const;
+};
+
+// Kernels: each result is computed modulo 2^result.width, which the caller sets.
+void wide_add(WideValue& r, const WideValue& a, const WideValue& b);
+void wide_sub(WideValue& r, const WideValue& a, const WideValue& b);
+void wide_mul(WideValue& r, const WideValue& a, const WideValue& b);
+void wide_divmod(WideValue* quot, WideValue* rem, const WideValue& a, const WideValue& b);
+void wide_shl(WideValue& r, const WideValue& a, unsigned long long n);
+void wide_shr(WideValue& r, const WideValue& a, unsigned long long n);
+// Shift by a wide amount; any amount of kMaxWireWidth or more shifts everything out.
+void wide_shl(WideValue& r, const WideValue& a, const WideValue& n);
+void wide_shr(WideValue& r, const WideValue& a, const WideValue& n);
+// Unsigned three-way comparison: negative, zero or positive.
+int wide_compare(const WideValue& a, const WideValue& b);
+
+// Evaluate one wide op (op.width != 0) over the slot array. Operands of 64
+// bits or fewer are sign-extended; a result of 64 bits or fewer is stored
+// as a single scalar slot.
+void eval_wide_op(const FlatOp& op, const unsigned short* slot_width, long long* v);
@@ -1,34 +1,130 @@
 #pragma once
 
+#include <atomic>
+#include <stdexcept>
 #include <string>
 #include <vector>
-#include <memory>
 
 #include "operations.h"
 
-struct Wire {
+// A clock domain derived from the simulation cycle: it ticks on the cycles
+// t with t % period == phase, so Clock("slow", 8) runs at 1/8 of the base
+// rate. Registers on a domain only update at the clock edge ending a tick.
+struct Clock {
     std::string name;
-    long long committed_value {0};
-    std::shared_ptr<ExprNode> comb_expr; // instantaneous (combinational) definition
-    std::shared_ptr<ExprNode> next_expr; // next-cycle (registered) definition
+    int period {1};
+    int phase {0};
 
-    static std::vector<Wire*>& registry() {
-        static std::vector<Wire*> r; return r;
+    explicit Clock(std::string name_, int period_ = 1, int phase_ = 0): name(std::move(name_)), period(period_), phase(phase_) {
+        if (period < 1) throw std::invalid_argument("clock '" + name + "': period must be positive");
+        if (phase < 0 || phase >= period) throw std::invalid_argument("clock '" + name + "': phase must be in 0..period-1");
     }
+};
 
-    explicit Wire(std::string name_, long long init = 0): name(std::move(name_)), committed_value(init) {
-        registry().push_back(this);
+// Bumped by every driver assignment to any wire and every write port added
+// to a memory; Wire::revision and Memory::revision hold the value after the
+// last one, so a compiled simulation can tell which of its wires and
+// memories were edited since (see Simulator::update()).
+inline std::atomic<unsigned long long>& wire_revisions() {
+    static std::atomic<unsigned long long> n {0};
+    return n;
+}
+
+struct Wire {
+    std::string name;
+    long long committed_value {0};
+    int width {64}; // bits; other widths hold unsigned values masked to this width
+    const ExprNode* comb_expr {nullptr}; // instantaneous (combinational) definition
+    const ExprNode* next_expr {nullptr}; // next-cycle (registered) definition
+    const Clock* clock {nullptr};        // domain of the register, nullptr for the base clock
+    const ExprNode* enable_expr {nullptr}; // register only updates when this is nonzero
+    unsigned long long revision {0};       // wire_revisions() after the last driver assignment
+    ExprArena* arena {nullptr};            // arena of the Circuit owning the wire, where its expressions go
+
+    explicit Wire(std::string name_, long long init = 0, int width_ = 64)
+        : name(std::move(name_)), committed_value(init & width_mask(width_)), width(width_) {
+        if (width < 1 || width > kMaxWireWidth) throw std::invalid_argument("wire '" + name + "': width must be 1.." + std::to_string(kMaxWireWidth));
     }
 
     operator Expr() const { return Expr::wireRef(this); }
 
     // Instantaneous assignment (=)
-    Wire& operator=(const Expr& rhs) { comb_expr = rhs.node; return *this; }
-    Wire& operator=(long long rhs) { comb_expr = Expr(rhs).node; return *this; }
+    Wire& operator=(const Expr& rhs) { comb_expr = rhs.node; return touch(); }
+    Wire& operator=(const Wire& rhs) { comb_expr = Expr(rhs).node; return touch(); }
+    Wire& operator=(long long rhs) { comb_expr = Expr(rhs).node; return touch(); }
 
     // Next-cycle assignment (<<)
-    Wire& operator<<(const Expr& rhs) { next_expr = rhs.node; return *this; }
-    Wire& operator<<(long long rhs) { next_expr = Expr(rhs).node; return *this; }
+    Wire& operator<<(const Expr& rhs) { next_expr = rhs.node; return touch(); }
+    Wire& operator<<(long long rhs) { next_expr = Expr(rhs).node; return touch(); }
+
+    // Register gating: `value.enable(en) << value + 1;` holds `value` on cycles
+    // where `en` is zero, and clocked_by() moves it to another domain. The
+    // engines skip next-state logic whose register does not update.
+    Wire& enable(const Expr& en) { enable_expr = en.node; return touch(); }
+    Wire& clocked_by(const Clock& c) { clock = &c; return touch(); }
+
+    // Marks the drivers as edited.
+    Wire& touch() {
+        revision = ++wire_revisions();
+        return *this;
+    }
 };
 
+inline Expr Expr::wireRef(const Wire* w) {
+    return Expr(ExprArena::current(w->arena).intern(OpType::WireRef, 0, w, nullptr, nullptr, nullptr), w->arena);
+}
 
+// Indexed storage: `depth` entries of `width` bits (at most 64) in one flat
+// array, so a read or write costs O(1) however deep the memory is.
+// `mem[addr]` reads the entry in the current cycle, or 0 for an address
+// outside [0, depth). Writes behave like `<<`: `mem[addr] << data` (or
+// write() with an enable) takes effect at the clock edge, after every read
+// of the cycle; a later write port wins when two hit the same entry, and
+// out-of-range writes are dropped. A memory without write ports is a ROM.
+struct Memory {
+    struct WritePort {
+        const ExprNode* addr;
+        const ExprNode* data;
+        const ExprNode* enable;
+    };
+
+    // `mem[addr]` as an operand, or as the target of `<<`.
+    struct Ref {
+        Memory* mem;
+        Expr addr;
+        operator Expr() const { return mem->read(addr); }
+        Ref& operator<<(const Expr& data) { mem->write(addr, data); return *this; }
+        Ref& operator<<(long long data) { mem->write(addr, Expr(data)); return *this; }
+    };
+
+    std::string name;
+    int depth;
+    int width {64};
+    std::vector<long long> contents; // committed entries, one per address
+    std::vector<WritePort> write_ports;
+    unsigned long long revision {0}; // wire_revisions() after the last write port was added
+
+    Memory(std::string name_, int depth_, int width_ = 64, std::vector<long long> init = {})
+        : name(std::move(name_)), depth(depth_), width(width_), contents(std::move(init)) {
+        if (depth < 1) throw std::invalid_argument("memory '" + name + "': depth must be positive");
+        if (width < 1 || width > 64) throw std::invalid_argument("memory '" + name + "': width must be 1..64");
+        if (contents.size() > static_cast<size_t>(depth)) throw std::invalid_argument("memory '" + name + "': more initial values than entries");
+        contents.resize(static_cast<size_t>(depth), 0);
+        for (long long& v : contents) v &= width_mask(width);
+    }
+
+    Expr read(const Expr& addr) const {
+        return Expr(ExprArena::current(addr.arena).intern(OpType::MemRead, 0, nullptr, addr.node, nullptr, nullptr, this), addr.arena);
+    }
+    // At the clock edge, entry `addr` takes `data` if `enable` is nonzero.
+    void write(const Expr& addr, const Expr& data, const Expr& enable) {
+        write_ports.push_back({addr.node, data.node, enable.node});
+        revision = ++wire_revisions();
+    }
+    void write(const Expr& addr, const Expr& data) { write(addr, data, Expr(1)); }
+
+    Ref operator[](const Expr& addr) { return Ref{this, addr}; }
+    Ref operator[](long long addr) { return Ref{this, Expr(addr)}; }
+    Expr operator[](const Expr& addr) const { return read(addr); }
+    Expr operator[](long long addr) const { return read(Expr(addr)); }
+};